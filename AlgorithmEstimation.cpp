@@ -1,8 +1,9 @@
 #include "AlgorithmEstimation.hpp"
+#include "StageProfiler.hpp"
+#include "KeypointGrid.hpp"
 #include <fstream>
 #include <iterator>
 #include <cstdint>
-#include <omp.h>
 
 bool computeMatchesDistanceStatistics(const Matches& matches, float& meanDistance, float& stdDev)
 {
@@ -29,21 +30,20 @@ float distance(const cv::Point2f a, const cv::Point2f b)
 
 cv::Scalar computeReprojectionError(const Keypoints& source, const Keypoints& query, const Matches& matches, const cv::Mat& homography);
 
-bool performEstimation
+void evaluateFrame
 (
     const FeatureAlgorithm& alg,
     const ImageTransformation& transformation,
-    const cv::Mat& sourceImage,
+    int algorithmId,
+    int transformationId,
+    const TransformedFrame& frame,
+    const FeatureCache& featureCache,
     const Keypoints& sourceKp,
-    const Descriptors& sourceDesc,
-    std::vector<FrameMatchingStatistics>& stat
+    const std::vector<int>& sourceKpIndices,
+    const PreparedTrainSet& sourceTrain,
+    FrameMatchingStatistics& s
 )
 {
-    std::vector<float> x = transformation.getX();
-    stat.resize(x.size());
-
-    const int count = x.size();
-
     Keypoints   resKpReal;
     Descriptors resDesc;
     Matches     matches;
@@ -51,81 +51,119 @@ bool performEstimation
     // To convert ticks to milliseconds
     const double toMsMul = 1000. / cv::getTickFrequency();
 
-    #pragma omp parallel for private(resKpReal, resDesc, matches) schedule(dynamic, 10)
-    for (int i = 0; i < count; i++)
+    const float    arg              = frame.argument;
+    const cv::Mat& transformedImage = frame.image;
+
+    // Descriptors loaded from the cache were timed and counted by another run, maybe on another machine,
+    // so their cost is not reported as part of this one
+    CachedFeatures   features;
+    bool             describeMeasured = false;
+    double           describeTimeMs   = 0;
+    AllocationCounts describeAllocations;
+    PerfCounts       describeCounters;
+    if (featureCache.load(frame.cacheKey, alg.fingerprint, features))
     {
-        //std::cout << "Threads: " << omp_get_num_threads() << std::endl;
-        float       arg = x[i];
-        FrameMatchingStatistics& s = stat[i];
-
-        cv::Mat     transformedImage;
-        transformation.transform(arg, sourceImage, transformedImage);
+        resKpReal = features.keypoints;
+        resDesc   = features.descriptors;
+    }
+    else
+    {
+        int64 start, end;
 
-        if (0)
+        resKpReal = frame.keypoints;
+        if (alg.extractDescriptors(transformedImage, resKpReal, resDesc, start, end, describeAllocations, describeCounters))
         {
-            cv::imwrite("Destination/" + transformation.name + std::to_string(i) + ".png", transformedImage);
-        }
-
-        cv::Mat expectedHomography = transformation.getHomography(arg, sourceImage);
+            features.keypoints   = resKpReal;
+            features.descriptors = resDesc;
+            describeTimeMs       = (end - start) * toMsMul;
+            featureCache.store(frame.cacheKey, alg.fingerprint, features);
+            describeMeasured = true;
 
-        int64 start, end;
-        size_t memoryAllocated;
-        //cv::clearMemoryAllocated(); // Only works with custom compiled OpenCV version
-
-        alg.extractFeatures(transformedImage, resKpReal, resDesc, start, end, memoryAllocated);
-
-        // Initialize required fields
-        s.memoryAllocated = memoryAllocated;
-        s.isValid        = resKpReal.size() > 0;
-        s.argumentValue  = arg;
-        s.alg            = alg.name;
-        s.trans          = transformation.name;
-        if (!s.isValid) {
-            std::cout << "Skipped for: " << alg.name << "\t" << transformation.name << "\t" << arg << std::endl;
-            continue;
+            StageProfiler::instance().record(StageDescribe, algorithmId, transformationId, describeTimeMs);
         }
+    }
 
-        alg.matchFeatures(sourceDesc, resDesc, matches);
-
-        std::vector<cv::Point2f> sourcePoints, sourcePointsInFrame;
-        cv::KeyPoint::convert(sourceKp, sourcePoints);
-        cv::perspectiveTransform(sourcePoints, sourcePointsInFrame, expectedHomography);
+    // Initialize required fields
+    s.isValid        = resKpReal.size() > 0;
+    s.argumentValue  = arg;
+    if (!s.isValid) {
+        std::cout << "Skipped for: " << alg.name << "\t" << transformation.name << "\t" << arg << std::endl;
+        return;
+    }
 
-        cv::Mat homography;
+    PerfCounts       matchCounters;
+    AllocationCounts matchAllocations;
+    {
+        ScopedStageTimer timer(StageMatch, algorithmId, transformationId);
+        PerfSection section;
+        AllocationScope allocationScope;
+        if (alg.knMatchSupported)
+            alg.ratioMatchFeatures(sourceTrain, resDesc, matches);
+        else
+            alg.matchFeatures(sourceTrain, resDesc, matches);
+        allocationScope.stop(matchAllocations);
+        section.stop(matchCounters, resDesc.rows);
+    }
 
-        int visibleFeatures = 0;
-        int correctMatches  = 0;
-        int matchesCount    = matches.size();
+    const int64 groundTruthStart = cv::getTickCount();
 
-        for (int i = 0; i < sourcePoints.size(); i++)
+    // Source keypoints of this algorithm projected into the frame
+    std::vector<cv::Point2f> sourcePointsInFrame(sourceKp.size());
+    for (size_t k = 0; k < sourceKp.size(); k++)
+    {
+        if (sourceKpIndices[k] >= 0)
         {
-            if (sourcePointsInFrame[i].x > 0 &&
-                    sourcePointsInFrame[i].y > 0 &&
-                    sourcePointsInFrame[i].x < transformedImage.cols &&
-                    sourcePointsInFrame[i].y < transformedImage.rows)
-            {
-                visibleFeatures++;
-            }
+            sourcePointsInFrame[k] = frame.sourcePointsInFrame[sourceKpIndices[k]];
         }
-
-        for (int i = 0; i < matches.size(); i++)
+        else
         {
-            cv::Point2f expected = sourcePointsInFrame[matches[i].trainIdx];
-            cv::Point2f actual   = resKpReal[matches[i].queryIdx].pt;
+            std::vector<cv::Point2f> point(1, sourceKp[k].pt);
+            cv::perspectiveTransform(point, point, frame.expectedHomography);
+            sourcePointsInFrame[k] = point[0];
+        }
+    }
+
+    int visibleFeatures = 0;
+    int correctMatches  = 0;
+    int matchesCount    = matches.size();
 
-            if (distance(expected, actual) < 3.0)
-            {
-                correctMatches++;
-            }
+    for (int i = 0; i < sourcePointsInFrame.size(); i++)
+    {
+        if (sourcePointsInFrame[i].x > 0 &&
+                sourcePointsInFrame[i].y > 0 &&
+                sourcePointsInFrame[i].x < transformedImage.cols &&
+                sourcePointsInFrame[i].y < transformedImage.rows)
+        {
+            visibleFeatures++;
         }
+    }
 
-        s.totalKeypoints += resKpReal.size();
-        s.consumedTimeMs += (end - start) * toMsMul;
-        s.precision += correctMatches / (float) matchesCount;
-        s.recall += correctMatches / (float) visibleFeatures;
+    for (int i = 0; i < matches.size(); i++)
+    {
+        cv::Point2f expected = sourcePointsInFrame[matches[i].trainIdx];
+        cv::Point2f actual   = resKpReal[matches[i].queryIdx].pt;
+
+        if (distance(expected, actual) < 3.0)
+        {
+            correctMatches++;
+        }
     }
 
-    return true;
+    int sharedKeypoints;
+    const float repeatability = computeRepeatability(sourcePointsInFrame, resKpReal, transformedImage.size(), 3.0f, sharedKeypoints);
+    const float matchingScore = sharedKeypoints > 0 ? correctMatches / (float) sharedKeypoints : 0;
+
+    StageProfiler::instance().record(StageGroundTruth, algorithmId, transformationId,
+                                     (cv::getTickCount() - groundTruthStart) * toMsMul);
+
+    s.addSample(resKpReal.size(),
+                correctMatches / (float) matchesCount,
+                correctMatches / (float) visibleFeatures,
+                repeatability, matchingScore,
+                matchAllocations, matchCounters);
+
+    if (describeMeasured)
+        s.addDescribeCost(resKpReal.size(), describeTimeMs, describeAllocations, describeCounters);
 }
 
 cv::Scalar computeReprojectionError(const Keypoints& source, const Keypoints& query, const Matches& matches, const cv::Mat& homography)
@@ -4,18 +4,25 @@
 #include "CollectedStatistics.hpp"
 #include "FeatureAlgorithm.hpp"
 #include "ImageTransformation.hpp"
+#include "FrameCache.hpp"
 
 
 bool computeMatchesDistanceStatistics(const Matches& matches, float& meanDistance, float& stdDev);
 
-void ratioTest(const std::vector<Matches>& knMatches, float maxRatio, Matches& goodMatches);
-
-bool performEstimation(const FeatureAlgorithm& alg,
-                       const ImageTransformation& transformation,
-                       const cv::Mat& sourceImage,
-                       const Keypoints& sourceKp,
-                       const Descriptors& sourceDesc,
-                       SingleRunStatistics& stat);
+//! Evaluates the algorithm on one cached frame of a transformation.
+//! sourceKpIndices maps every keypoint of sourceKp to its index in the keypoints the frame cache was built from.
+//! Descriptors of the frame are looked up in and added to featureCache, and matched against sourceTrain.
+//! algorithmId and transformationId are the ids of their names in NameTable.
+void evaluateFrame(const FeatureAlgorithm& alg,
+                   const ImageTransformation& transformation,
+                   int algorithmId,
+                   int transformationId,
+                   const TransformedFrame& frame,
+                   const FeatureCache& featureCache,
+                   const Keypoints& sourceKp,
+                   const std::vector<int>& sourceKpIndices,
+                   const PreparedTrainSet& sourceTrain,
+                   FrameMatchingStatistics& s);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define ALLOCATION_TRACKING 1
+#endif
+
+namespace
+{
+    // Plain data, so that the thread local needs no constructor and is safe to use inside malloc
+    struct ThreadAllocations
+    {
+        uint64_t bytes;
+        uint64_t allocations;
+        int64_t  live;
+        int64_t  peak;
+        int      activeScopes;
+    };
+
+    __thread ThreadAllocations threadAllocations;
+}
+
+#pragma mark - AllocationCounts implementation
+
+AllocationCounts::AllocationCounts()
+: bytes(0)
+, allocations(0)
+, peakBytes(0)
+{
+}
+
+void AllocationCounts::merge(const AllocationCounts& other)
+{
+    bytes       += other.bytes;
+    allocations += other.allocations;
+    peakBytes    = std::max(peakBytes, other.peakBytes);
+}
+
+#pragma mark - malloc interposition
+
+#if defined(ALLOCATION_TRACKING)
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void* __libc_valloc(size_t size);
+    void* __libc_pvalloc(size_t size);
+    void  __libc_free(void* ptr);
+}
+
+// Usable sizes are recorded on both ends so that allocation and release always balance
+static inline void recordAllocation(void* ptr)
+{
+    ThreadAllocations& t = threadAllocations;
+    if (ptr == NULL || t.activeScopes == 0)
+        return;
+
+    const size_t size = malloc_usable_size(ptr);
+    t.bytes += size;
+    t.allocations++;
+    t.live += size;
+    t.peak = std::max(t.peak, t.live);
+}
+
+static inline void recordRelease(void* ptr)
+{
+    ThreadAllocations& t = threadAllocations;
+    if (ptr == NULL || t.activeScopes == 0)
+        return;
+
+    t.live -= malloc_usable_size(ptr);
+}
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        void* ptr = __libc_malloc(size);
+        recordAllocation(ptr);
+        return ptr;
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        void* ptr = __libc_calloc(count, size);
+        recordAllocation(ptr);
+        return ptr;
+    }
+
+    void* realloc(void* ptr, size_t size)
+    {
+        recordRelease(ptr);
+        void* result = __libc_realloc(ptr, size);
+
+        // On failure the original block is still owned by the caller
+        recordAllocation(result != NULL || size == 0 ? result : ptr);
+        return result;
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        void* ptr = __libc_memalign(alignment, size);
+        recordAllocation(ptr);
+        return ptr;
+    }
+
+    void* valloc(size_t size)
+    {
+        void* ptr = __libc_valloc(size);
+        recordAllocation(ptr);
+        return ptr;
+    }
+
+    void* pvalloc(size_t size)
+    {
+        void* ptr = __libc_pvalloc(size);
+        recordAllocation(ptr);
+        return ptr;
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size)
+    {
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        void* ptr = memalign(alignment, size);
+        if (ptr == NULL && size != 0)
+            return ENOMEM;
+
+        *result = ptr;
+        return 0;
+    }
+
+    void free(void* ptr)
+    {
+        recordRelease(ptr);
+        __libc_free(ptr);
+    }
+}
+
+#endif
+
+#pragma mark - AllocationScope implementation
+
+AllocationScope::AllocationScope()
+{
+    ThreadAllocations& t = threadAllocations;
+
+    m_active           = true;
+    m_startBytes       = t.bytes;
+    m_startAllocations = t.allocations;
+    m_startLive        = t.live;
+    m_outerPeak        = t.peak;
+
+    // The peak of this section is measured from the current level
+    t.peak = t.live;
+    t.activeScopes++;
+}
+
+AllocationScope::~AllocationScope()
+{
+    AllocationCounts ignored;
+    stop(ignored);
+}
+
+void AllocationScope::stop(AllocationCounts& counts)
+{
+    if (!m_active)
+        return;
+
+    ThreadAllocations& t = threadAllocations;
+    t.activeScopes--;
+
+    counts.bytes       += t.bytes - m_startBytes;
+    counts.allocations += t.allocations - m_startAllocations;
+    counts.peakBytes    = std::max<uint64_t>(counts.peakBytes, std::max<int64_t>(t.peak - m_startLive, 0));
+
+    // Enclosing sections see the peak of this one
+    t.peak = std::max(m_outerPeak, t.peak);
+    m_active = false;
+}
+
+bool AllocationScope::isAvailable()
+{
+#if defined(ALLOCATION_TRACKING)
+    return true;
+#else
+    return false;
+#endif
+}
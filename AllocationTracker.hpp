@@ -0,0 +1,49 @@
+#ifndef AllocationTracker_hpp
+#define AllocationTracker_hpp
+
+#include <cstdint>
+
+//! Heap usage of a measured section.
+struct AllocationCounts
+{
+    AllocationCounts();
+
+    //! Total bytes and number of blocks allocated.
+    uint64_t bytes;
+    uint64_t allocations;
+
+    //! Largest amount of memory held at once, on top of what was live when the section started.
+    uint64_t peakBytes;
+
+    //! Sums bytes and allocations, keeps the larger peak.
+    void merge(const AllocationCounts& other);
+};
+
+//! Counts the heap allocations of the calling thread from construction until stop(). Sections
+//! may nest. Counting relies on interposing malloc and friends, which is only done with glibc;
+//! elsewhere nothing is counted. Allocations made on other threads are not attributed to the
+//! section, which is why the evaluation limits OpenCV to the calling thread (cv::setNumThreads(1)).
+class AllocationScope
+{
+public:
+    AllocationScope();
+    ~AllocationScope();
+
+    //! Adds the allocations since construction to counts.
+    void stop(AllocationCounts& counts);
+
+    //! Whether allocations are counted at all in this build.
+    static bool isAvailable();
+
+private:
+    AllocationScope(const AllocationScope&);
+    AllocationScope& operator=(const AllocationScope&);
+
+    bool     m_active;
+    uint64_t m_startBytes;
+    uint64_t m_startAllocations;
+    int64_t  m_startLive;
+    int64_t  m_outerPeak;
+};
+
+#endif
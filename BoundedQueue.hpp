@@ -0,0 +1,66 @@
+#ifndef BoundedQueue_hpp
+#define BoundedQueue_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+//! Fixed-capacity blocking queue connecting a producer and a consumer thread.
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1)
+    , m_closed(false)
+    {
+    }
+
+    //! Blocks while the queue is full. Returns false if the queue has been closed.
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+
+        if (m_closed)
+            return false;
+
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    //! Blocks while the queue is empty. Returns false once the queue is closed and drained.
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+
+        if (m_items.empty())
+            return false;
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    //! Stops accepting new items and wakes up all waiting producers and consumers.
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    const size_t            m_capacity;
+    bool                    m_closed;
+    std::deque<T>           m_items;
+    std::mutex              m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+};
+
+#endif
@@ -1,10 +1,13 @@
 #include "CollectedStatistics.hpp"
+#include "ThreadLocalPool.hpp"
 
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <iterator>
 #include <numeric>
 #include <cassert>
+#include <cmath>
 
 template<typename T>
 std::string quote(const T& t)
@@ -27,92 +30,261 @@ std::ostream& null(std::ostream& str)
 FrameMatchingStatistics::FrameMatchingStatistics()
 {
     totalKeypoints = 0;
+    measuredKeypoints = 0;
     argumentValue = 0;
-    percentOfMatches = 0;
-    ratioTestFalseLevel = 0;
-    meanDistance = 0;
-    stdDevDistance = 0;
-    matchingRatio = 0;
     recall = 0;
     precision = 0;
+    repeatability = 0;
+    matchingScore = 0;
     consumedTimeMs = 0;
-    homographyError = std::numeric_limits<float>::max();
     isValid = false;
-    memoryAllocated = 0;
-    alg = "";
-    trans = "";
 }
 
+void FrameMatchingStatistics::addSample(int keypoints, float precision, float recall, float repeatability, float matchingScore,
+                                        const AllocationCounts& matchAllocations, const PerfCounts& matchCounters)
+{
+    isValid = true;
+
+    this->totalKeypoints  += keypoints;
+    this->precision       += precision;
+    this->recall          += recall;
+    this->repeatability   += repeatability;
+    this->matchingScore   += matchingScore;
 
-bool FrameMatchingStatistics::tryGetValue(StatisticElement element, float& value) const
+    this->matchAllocations.merge(matchAllocations);
+    this->matchCounters.merge(matchCounters);
+}
+
+void FrameMatchingStatistics::addDescribeCost(int keypoints, float timeMs, const AllocationCounts& describeAllocations, const PerfCounts& describeCounters)
 {
-    if (!isValid)
-        return false;
+    this->measuredKeypoints += keypoints;
+    this->consumedTimeMs    += timeMs;
 
-    switch (element)
+    this->describeAllocations.merge(describeAllocations);
+    this->describeCounters.merge(describeCounters);
+}
+
+#pragma mark - StatisticsCells implementation
+
+size_t StatisticsCells::size() const
+{
+    return argumentValue.size();
+}
+
+void StatisticsCells::resize(size_t size)
+{
+    argumentValue.resize(size, 0);
+    isValid.resize(size, 0);
+    totalKeypoints.resize(size, 0);
+    measuredKeypoints.resize(size, 0);
+    consumedTimeMs.resize(size, 0);
+    precision.resize(size, 0);
+    recall.resize(size, 0);
+    undefinedPrecisions.resize(size, 0);
+    undefinedRecalls.resize(size, 0);
+    repeatability.resize(size, 0);
+    matchingScore.resize(size, 0);
+    precisionStats.resize(size);
+    recallStats.resize(size);
+    consumedTimeStats.resize(size);
+    consumedTimeHistogram.resize(size);
+    describeAllocations.resize(size);
+    matchAllocations.resize(size);
+    describeCounters.resize(size);
+    matchCounters.resize(size);
+}
+
+void StatisticsCells::add(size_t cell, const FrameMatchingStatistics& frame)
+{
+    // Everything added to a cell has the same argument
+    argumentValue[cell] = frame.argumentValue;
+
+    if (!frame.isValid)
+        return;
+
+    isValid[cell]         = 1;
+    totalKeypoints[cell] += frame.totalKeypoints;
+    repeatability[cell]  += frame.repeatability;
+    matchingScore[cell]  += frame.matchingScore;
+
+    // Left out of the sums and the distributions, which they would otherwise turn into NaN
+    if (std::isnan(frame.precision))
     {
-    case  StatisticsElementPointsCount:
-        value = totalKeypoints;
-        return true;
+        undefinedPrecisions[cell]++;
+    }
+    else
+    {
+        precision[cell] += frame.precision;
+        precisionStats[cell].add(frame.precision);
+    }
 
-    case StatisticsElementPercentOfCorrectMatches:
-        //value = correctMatchesPercent * 100;
-        return false;
+    if (std::isnan(frame.recall))
+    {
+        undefinedRecalls[cell]++;
+    }
+    else
+    {
+        recall[cell] += frame.recall;
+        recallStats[cell].add(frame.recall);
+    }
 
-    case StatisticsElementPercentOfMatches:
-        value = percentOfMatches * 100;
-        return true;
+    matchAllocations[cell].merge(frame.matchAllocations);
+    matchCounters[cell].merge(frame.matchCounters);
 
-    case StatisticsElementMeanDistance:
-        value = meanDistance;
-        return true;
+    if (frame.measuredKeypoints > 0)
+    {
+        measuredKeypoints[cell] += frame.measuredKeypoints;
+        consumedTimeMs[cell]    += frame.consumedTimeMs;
 
-    case StatisticsElementHomographyError:
-        value = homographyError;
-        return true;
+        consumedTimeStats[cell].add(frame.consumedTimeMs);
+        consumedTimeHistogram[cell].add(frame.consumedTimeMs);
 
-    case StatisticsElementMatchingRatio:
-        value = matchingRatio;
-        return true;
+        describeAllocations[cell].merge(frame.describeAllocations);
+        describeCounters[cell].merge(frame.describeCounters);
+    }
+}
 
-    case StatisticsElementPatternLocalization:
-        //value = patternLocalization();
+void StatisticsCells::merge(size_t cell, const StatisticsCells& other, size_t otherCell)
+{
+    // Everything merged into a cell has the same argument, except cells that were never recorded, which have 0
+    if (other.argumentValue[otherCell] != 0)
+        argumentValue[cell] = other.argumentValue[otherCell];
+
+    if (!other.isValid[otherCell])
+        return;
+
+    isValid[cell]              = 1;
+    totalKeypoints[cell]      += other.totalKeypoints[otherCell];
+    measuredKeypoints[cell]   += other.measuredKeypoints[otherCell];
+    consumedTimeMs[cell]      += other.consumedTimeMs[otherCell];
+    precision[cell]           += other.precision[otherCell];
+    recall[cell]              += other.recall[otherCell];
+    repeatability[cell]       += other.repeatability[otherCell];
+    matchingScore[cell]       += other.matchingScore[otherCell];
+    undefinedPrecisions[cell] += other.undefinedPrecisions[otherCell];
+    undefinedRecalls[cell]    += other.undefinedRecalls[otherCell];
+
+    precisionStats[cell].merge(other.precisionStats[otherCell]);
+    recallStats[cell].merge(other.recallStats[otherCell]);
+    consumedTimeStats[cell].merge(other.consumedTimeStats[otherCell]);
+    consumedTimeHistogram[cell].merge(other.consumedTimeHistogram[otherCell]);
+
+    describeAllocations[cell].merge(other.describeAllocations[otherCell]);
+    matchAllocations[cell].merge(other.matchAllocations[otherCell]);
+    describeCounters[cell].merge(other.describeCounters[otherCell]);
+    matchCounters[cell].merge(other.matchCounters[otherCell]);
+}
+
+bool StatisticsCells::tryGetValue(size_t cell, StatisticElement element, float& value) const
+{
+    if (!isValid[cell])
         return false;
+
+    const int   keypoints = totalKeypoints[cell];
+    const int   measured  = measuredKeypoints[cell];
+    const float timeMs    = consumedTimeMs[cell];
+
+    switch (element)
+    {
+    case  StatisticsElementPointsCount:
+        value = keypoints;
+        return true;
+
     case StatisticsElementPrecision:
-        value = precision;
+        value = precision[cell];
         return true;
     case StatisticsElementMemoryAllocated:
-        value = memoryAllocated;
-        return true;
+        value = describeAllocations[cell].bytes;
+        return AllocationScope::isAvailable() && measured > 0;
     case StatisticsElementConsumedTimeMs:
-        value = consumedTimeMs;
-        return true;
+        value = timeMs;
+        return measured > 0;
     case StatisticsElementConsumedTimeMsPerDescriptor:
-        value = consumedTimeMs / totalKeypoints;
-        return true;
+        value = timeMs / measured;
+        return measured > 0;
     case StatisticsElementMemoryAllocatedPerDescriptor:
-        value = memoryAllocated / totalKeypoints;
-        return true;
+        value = describeAllocations[cell].bytes / (float) measured;
+        return AllocationScope::isAvailable() && measured > 0;
     case StatisticsElementRecall:
-        value = recall;
+        value = recall[cell];
+        return true;
+    case StatisticsElementPrecisionStdDev:
+        value = precisionStats[cell].stdDev();
         return true;
+    case StatisticsElementRecallStdDev:
+        value = recallStats[cell].stdDev();
+        return true;
+    case StatisticsElementConsumedTimeMsMean:
+        value = consumedTimeStats[cell].mean();
+        return measured > 0;
+    case StatisticsElementConsumedTimeMsStdDev:
+        value = consumedTimeStats[cell].stdDev();
+        return measured > 0;
+    case StatisticsElementConsumedTimeMsP50:
+        value = consumedTimeHistogram[cell].quantile(0.50);
+        return measured > 0;
+    case StatisticsElementConsumedTimeMsP95:
+        value = consumedTimeHistogram[cell].quantile(0.95);
+        return measured > 0;
+    case StatisticsElementConsumedTimeMsP99:
+        value = consumedTimeHistogram[cell].quantile(0.99);
+        return measured > 0;
+    case StatisticsElementDescribeCyclesPerDescriptor:
+        return describeCounters[cell].tryGetPerDescriptor(PerfEventCycles, value);
+    case StatisticsElementDescribeInstructionsPerDescriptor:
+        return describeCounters[cell].tryGetPerDescriptor(PerfEventInstructions, value);
+    case StatisticsElementDescribeCacheMissesPerDescriptor:
+        return describeCounters[cell].tryGetPerDescriptor(PerfEventCacheMisses, value);
+    case StatisticsElementDescribeBranchMissesPerDescriptor:
+        return describeCounters[cell].tryGetPerDescriptor(PerfEventBranchMisses, value);
+    case StatisticsElementMatchCyclesPerDescriptor:
+        return matchCounters[cell].tryGetPerDescriptor(PerfEventCycles, value);
+    case StatisticsElementMatchInstructionsPerDescriptor:
+        return matchCounters[cell].tryGetPerDescriptor(PerfEventInstructions, value);
+    case StatisticsElementMatchCacheMissesPerDescriptor:
+        return matchCounters[cell].tryGetPerDescriptor(PerfEventCacheMisses, value);
+    case StatisticsElementMatchBranchMissesPerDescriptor:
+        return matchCounters[cell].tryGetPerDescriptor(PerfEventBranchMisses, value);
+    case StatisticsElementAllocationsPerDescriptor:
+        value = describeAllocations[cell].allocations / (float) measured;
+        return AllocationScope::isAvailable() && measured > 0;
+    case StatisticsElementPeakMemory:
+        value = describeAllocations[cell].peakBytes;
+        return AllocationScope::isAvailable() && measured > 0;
+    case StatisticsElementMatchMemoryAllocatedPerDescriptor:
+        value = matchAllocations[cell].bytes / (float) keypoints;
+        return AllocationScope::isAvailable();
+    case StatisticsElementMatchAllocationsPerDescriptor:
+        value = matchAllocations[cell].allocations / (float) keypoints;
+        return AllocationScope::isAvailable();
+    case StatisticsElementMatchPeakMemory:
+        value = matchAllocations[cell].peakBytes;
+        return AllocationScope::isAvailable();
+    case StatisticsElementRepeatability:
+        value = repeatability[cell];
+        return true;
+    case StatisticsElementMatchingScore:
+        value = matchingScore[cell];
+        return true;
+
+    // Not measured by the evaluation
+    case StatisticsElementPercentOfCorrectMatches:
+    case StatisticsElementPercentOfMatches:
+    case StatisticsElementMeanDistance:
+    case StatisticsElementHomographyError:
+    case StatisticsElementMatchingRatio:
+    case StatisticsElementPatternLocalization:
     default:
         return false;
     }
 }
 
-void FrameMatchingStatistics::getAlgTransInfo(std::string& alg, std::string& trans) const {
-    alg = this->alg;
-    trans = this->trans;
-}
-
-std::ostream& FrameMatchingStatistics::writeElement(std::ostream& str, StatisticElement elem) const
+static std::ostream& writeElement(std::ostream& str, const RunStatistics& run, size_t index, StatisticElement elem,
+                                  const std::string& alg, const std::string& trans)
 {
     float value;
-    std::string alg, trans;
-    getAlgTransInfo(alg, trans);
 
-    if (tryGetValue(elem, value))
+    if (run.tryGetValue(index, elem, value))
     {
         str << alg << tab << trans << tab << value << std::endl;
     }
@@ -124,85 +296,257 @@ std::ostream& FrameMatchingStatistics::writeElement(std::ostream& str, Statistic
     return str;
 }
 
-SingleRunStatistics& CollectedStatistics::getStatistics(std::string algorithmName, std::string transformationName)
+#pragma mark - RunStatistics implementation
+
+RunStatistics::RunStatistics()
+: cells(0)
+, first(0)
+, size(0)
 {
-    return m_allStats[std::make_pair(algorithmName, transformationName)];
 }
 
+RunStatistics::RunStatistics(const StatisticsCells* cells, size_t first, size_t size)
+: cells(cells)
+, first(first)
+, size(size)
+{
+}
 
-CollectedStatistics::OuterGroup CollectedStatistics::groupByAlgorithmThenByTransformation() const
+#pragma mark - NameTable implementation
+
+NameTable::NameTable()
 {
-    OuterGroup result;
+    for (int i = 0; i < MaxNames; i++)
+        m_published[i] = 0;
+}
 
-    for (std::map<Key, SingleRunStatistics>::const_iterator i = m_allStats.begin(); i != m_allStats.end(); ++i)
-    {
-        result[i->first.first][i->first.second] = &(i->second);
-    }
+NameTable& NameTable::algorithms()
+{
+    static NameTable table;
+    return table;
+}
+
+NameTable& NameTable::transformations()
+{
+    static NameTable table;
+    return table;
+}
+
+int NameTable::intern(const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    std::map<std::string, int>::const_iterator it = m_ids.find(name);
+    if (it != m_ids.end())
+        return it->second;
+
+    const int id = m_names.size();
+    CV_Assert(id < MaxNames);
+
+    m_names.push_back(name);
+    it = m_ids.insert(std::make_pair(name, id)).first;
+    m_sortedIds.insert(m_sortedIds.begin() + std::distance(m_ids.cbegin(), it), id);
+
+    // Elements of a deque stay in place when it grows, so readers can keep the pointer without the lock
+    m_published[id].store(&m_names.back(), std::memory_order_release);
+    return id;
+}
+
+const std::string& NameTable::name(int id) const
+{
+    return *m_published[id].load(std::memory_order_acquire);
+}
+
+const std::vector<int>& NameTable::sortedIds() const
+{
+    return m_sortedIds;
+}
+
+#pragma mark - CollectedStatistics implementation
+
+CollectedStatistics::CollectedStatistics()
+: m_cellsPerAlgorithm(0)
+, m_algorithmCount(0)
+{
+}
+
+int CollectedStatistics::algorithmCount() const
+{
+    return m_algorithmCount;
+}
 
-    return result;
+int CollectedStatistics::transformationCount() const
+{
+    return m_argumentCounts.size();
 }
 
-CollectedStatistics::OuterGroupLine CollectedStatistics::groupByTransformationThenByAlgorithm() const
+bool CollectedStatistics::hasRun(int algorithmId, int transformationId) const
 {
-    OuterGroup result;
+    return algorithmId < m_algorithmCount && transformationId < transformationCount() &&
+           m_runs[algorithmId * m_argumentCounts.size() + transformationId];
+}
 
-    for (std::map<Key, SingleRunStatistics>::const_iterator i = m_allStats.begin(); i != m_allStats.end(); ++i)
+void CollectedStatistics::reshape(int algorithmCount, const std::vector<size_t>& argumentCounts)
+{
+    std::vector<size_t> counts(std::max(argumentCounts.size(), m_argumentCounts.size()), 0);
+    for (size_t t = 0; t < counts.size(); t++)
     {
-        result[i->first.second][i->first.first] = &(i->second);
+        counts[t] = std::max(t < argumentCounts.size() ? argumentCounts[t] : 0,
+                             t < m_argumentCounts.size() ? m_argumentCounts[t] : 0);
     }
 
-    OuterGroupLine line;
+    algorithmCount = std::max(algorithmCount, m_algorithmCount);
+    if (algorithmCount == m_algorithmCount && counts == m_argumentCounts)
+        return;
 
-    for (OuterGroup::const_iterator tIter = result.begin(); tIter != result.end(); ++tIter)
+    std::vector<size_t> offsets(counts.size());
+    size_t cellsPerAlgorithm = 0;
+    for (size_t t = 0; t < counts.size(); t++)
     {
-        std::string transformationName               = tIter->first;
-        const CollectedStatistics::InnerGroup& inner = tIter->second;
-
-        GroupedByArgument& lineStat = line[transformationName];
+        offsets[t] = cellsPerAlgorithm;
+        cellsPerAlgorithm += counts[t];
+    }
 
-        std::vector<const SingleRunStatistics*> statitics;
+    std::vector<unsigned char> runs(algorithmCount * counts.size(), 0);
+    StatisticsCells            cells;
+    cells.resize(algorithmCount * cellsPerAlgorithm);
 
-        for (CollectedStatistics::InnerGroup::const_iterator algIter = inner.begin(); algIter != inner.end(); ++algIter)
+    for (int a = 0; a < m_algorithmCount; a++)
+    {
+        for (size_t t = 0; t < m_argumentCounts.size(); t++)
         {
-            std::string algName = algIter->first;
+            runs[a * counts.size() + t] = m_runs[a * m_argumentCounts.size() + t];
 
-            lineStat.algorithms.push_back(algName);
-            statitics.push_back(algIter->second);
+            // Merging into an empty cell copies it
+            for (size_t i = 0; i < m_argumentCounts[t]; i++)
+                cells.merge(a * cellsPerAlgorithm + offsets[t] + i, m_cells, a * m_cellsPerAlgorithm + m_offsets[t] + i);
         }
+    }
+
+    m_argumentCounts.swap(counts);
+    m_offsets.swap(offsets);
+    m_cellsPerAlgorithm = cellsPerAlgorithm;
+    m_algorithmCount    = algorithmCount;
+    m_runs.swap(runs);
+    std::swap(m_cells, cells);
+}
+
+void CollectedStatistics::add(int algorithmId, int transformationId, size_t argumentIndex, const FrameMatchingStatistics& frame)
+{
+    CV_Assert(algorithmId >= 0 && transformationId >= 0);
 
-        const SingleRunStatistics& firstStat = *statitics.front();
-        int argumentsCount = firstStat.size();
+    if (algorithmId >= m_algorithmCount || transformationId >= transformationCount() ||
+        argumentIndex >= m_argumentCounts[transformationId])
+    {
+        std::vector<size_t> counts(transformationId + 1, 0);
+        counts[transformationId] = argumentIndex + 1;
+        reshape(algorithmId + 1, counts);
+    }
+
+    m_runs[algorithmId * m_argumentCounts.size() + transformationId] = 1;
+    m_cells.add(algorithmId * m_cellsPerAlgorithm + m_offsets[transformationId] + argumentIndex, frame);
+}
 
-        for (int i = 0; i < argumentsCount; i++)
+RunStatistics CollectedStatistics::run(int algorithmId, int transformationId) const
+{
+    if (!hasRun(algorithmId, transformationId))
+        return RunStatistics();
+
+    return RunStatistics(&m_cells, algorithmId * m_cellsPerAlgorithm + m_offsets[transformationId],
+                         m_argumentCounts[transformationId]);
+}
+
+void CollectedStatistics::merge(const CollectedStatistics& other)
+{
+    // After the first image all images have the same shape and this does nothing
+    reshape(other.m_algorithmCount, other.m_argumentCounts);
+
+    for (int a = 0; a < other.m_algorithmCount; a++)
+    {
+        for (size_t t = 0; t < other.m_argumentCounts.size(); t++)
         {
-            Line l;
-            l.argument = firstStat[i].argumentValue;
+            if (!other.hasRun(a, t))
+                continue;
 
-            for (int algIndex = 0; algIndex < statitics.size(); algIndex++)
-            {
-                const SingleRunStatistics& s = *statitics[algIndex];
+            m_runs[a * m_argumentCounts.size() + t] = 1;
 
-                l.stats.push_back(&s[i]);
-            }
+            const size_t target = a * m_cellsPerAlgorithm + m_offsets[t];
+            const size_t source = a * other.m_cellsPerAlgorithm + other.m_offsets[t];
 
-            lineStat.lines.push_back(l);
+            for (size_t i = 0; i < other.m_argumentCounts[t]; i++)
+                m_cells.merge(target + i, other.m_cells, source + i);
         }
     }
+}
 
+#pragma mark - ShardedStatistics implementation
 
-    return line;
+ShardedStatistics::ShardedStatistics()
+: m_shards(MaxShards)
+{
+}
+
+void ShardedStatistics::record(int algorithmId, int transformationId, size_t frameIndex, FrameMatchingStatistics frame)
+{
+    const int slot = currentThreadSlot();
+    CV_Assert(slot < MaxShards);
+
+    Record record;
+    record.algorithmId      = algorithmId;
+    record.transformationId = transformationId;
+    record.frameIndex       = frameIndex;
+    record.frame            = std::move(frame);
+
+    m_shards[slot].records.push_back(std::move(record));
 }
 
+void ShardedStatistics::collect(CollectedStatistics& stat)
+{
+    std::vector<const Record*> records;
+    for (size_t i = 0; i < m_shards.size(); i++)
+    {
+        for (size_t j = 0; j < m_shards[i].records.size(); j++)
+            records.push_back(&m_shards[i].records[j]);
+    }
+
+    // Floating point sums depend on the order of the merges, so it must not depend on the threads
+    std::stable_sort(records.begin(), records.end(), [](const Record* a, const Record* b)
+    {
+        if (a->algorithmId != b->algorithmId)
+            return a->algorithmId < b->algorithmId;
+        if (a->transformationId != b->transformationId)
+            return a->transformationId < b->transformationId;
+        return a->frameIndex < b->frameIndex;
+    });
+
+    for (size_t i = 0; i < records.size(); i++)
+        stat.add(records[i]->algorithmId, records[i]->transformationId, records[i]->frameIndex, records[i]->frame);
+
+    for (size_t i = 0; i < m_shards.size(); i++)
+        std::vector<Record>().swap(m_shards[i].records);
+}
+
+#pragma mark - Reports
+
 std::ostream& CollectedStatistics::printAverage(std::ostream& str, StatisticElement elem) const
 {
-    OuterGroup result;
+    const std::vector<int>& algorithms      = NameTable::algorithms().sortedIds();
+    const std::vector<int>& transformations = NameTable::transformations().sortedIds();
+
     str << "Average" << std::endl;
 
-    for (std::map<Key, SingleRunStatistics>::const_iterator i = m_allStats.begin(); i != m_allStats.end(); ++i)
+    for (size_t a = 0; a < algorithms.size(); a++)
     {
-        result[i->first.second][i->first.first] = &(i->second);
+        for (size_t t = 0; t < transformations.size(); t++)
+        {
+            const RunStatistics run = this->run(algorithms[a], transformations[t]);
+            if (run.empty())
+                continue;
 
-        str << i->first.first << tab << i->first.second << tab << average(i->second, elem) << std::endl;
+            str << NameTable::algorithms().name(algorithms[a]) << tab
+                << NameTable::transformations().name(transformations[t]) << tab
+                << average(run, elem) << std::endl;
+        }
     }
 
     return str;
@@ -210,20 +554,33 @@ std::ostream& CollectedStatistics::printAverage(std::ostream& str, StatisticElem
 
 std::ostream& CollectedStatistics::printStatistics(std::ostream& str, StatisticElement elem) const
 {
-    CollectedStatistics::OuterGroupLine report = groupByTransformationThenByAlgorithm();
+    const std::vector<int>& algorithms      = NameTable::algorithms().sortedIds();
+    const std::vector<int>& transformations = NameTable::transformations().sortedIds();
 
-    for (CollectedStatistics::OuterGroupLine::const_iterator tIter = report.begin(); tIter != report.end(); ++tIter)
+    for (size_t t = 0; t < transformations.size(); t++)
     {
-        const GroupedByArgument& inner = tIter->second;
-        for (size_t i = 0; i < inner.lines.size(); i++)
-        {
-            const Line& l = inner.lines[i];
+        const int transformationId = transformations[t];
+        if (transformationId >= transformationCount())
+            continue;
+
+        const std::string& transformationName = NameTable::transformations().name(transformationId);
+
+        // One line per argument and algorithm, with the argument of the first algorithm that has the run
+        RunStatistics firstRun;
 
-            for (size_t j = 0; j < l.stats.size(); j++)
+        for (size_t i = 0; i < m_argumentCounts[transformationId]; i++)
+        {
+            for (size_t a = 0; a < algorithms.size(); a++)
             {
-                str << l.argument << tab;
-                const FrameMatchingStatistics& item = *l.stats[j];
-                item.writeElement(str, elem);
+                const RunStatistics run = this->run(algorithms[a], transformationId);
+                if (run.empty())
+                    continue;
+
+                if (firstRun.empty())
+                    firstRun = run;
+
+                str << m_cells.argumentValue[firstRun.cell(i)] << tab;
+                writeElement(str, run, i, elem, NameTable::algorithms().name(algorithms[a]), transformationName);
             }
         }
     }
@@ -238,75 +595,80 @@ std::ostream& CollectedStatistics::printPerformanceStatistics(std::ostream& str)
         << quote("Average time per Frame")    << tab
         << quote("Average time per KeyPoint") << std::endl;
 
-    CollectedStatistics::OuterGroup report = groupByAlgorithmThenByTransformation();
+    const std::vector<int>& algorithms = NameTable::algorithms().sortedIds();
 
-    for (CollectedStatistics::OuterGroup::const_iterator alg = report.begin(); alg != report.end(); ++alg)
+    for (size_t a = 0; a < algorithms.size(); a++)
     {
-        std::vector<double> timePerFrames;
-        std::vector<double> timePerKeyPoint;
+        const int algorithmId = algorithms[a];
+        if (algorithmId >= m_algorithmCount)
+            continue;
 
-        for (CollectedStatistics::InnerGroup::const_iterator tIter = alg->second.begin(); tIter != alg->second.end(); ++tIter)
+        double timePerFrames   = 0;
+        double timePerKeyPoint = 0;
+        size_t frames          = 0;
+        bool   hasRuns         = false;
+
+        for (int t = 0; t < transformationCount(); t++)
         {
-            const SingleRunStatistics& runStatistics = *tIter->second;
-            for (size_t i = 0; i < runStatistics.size(); i++)
+            const RunStatistics runStatistics = run(algorithmId, t);
+            hasRuns = hasRuns || !runStatistics.empty();
+
+            for (size_t i = 0; i < runStatistics.size; i++)
             {
-                if (runStatistics[i].isValid)
+                const size_t cell = runStatistics.cell(i);
+                if (m_cells.isValid[cell] && m_cells.measuredKeypoints[cell] > 0)
                 {
-                    timePerFrames.push_back(runStatistics[i].consumedTimeMs);
-                    timePerKeyPoint.push_back(runStatistics[i].totalKeypoints > 0 ? (runStatistics[i].consumedTimeMs / runStatistics[i].totalKeypoints) : 0);
+                    timePerFrames   += m_cells.consumedTimeMs[cell];
+                    timePerKeyPoint += m_cells.consumedTimeMs[cell] / m_cells.measuredKeypoints[cell];
+                    frames++;
                 }
             }
         }
 
-        double avgPerFrame    = std::accumulate(timePerFrames.begin(),   timePerFrames.end(), 0.0)     / timePerFrames.size();
-        double avgPerKeyPoint = std::accumulate(timePerKeyPoint.begin(), timePerKeyPoint.end(), 0.0) / timePerKeyPoint.size();
+        if (!hasRuns)
+            continue;
 
-        str << quote(alg->first) << tab
-            << avgPerFrame       << tab
-            << avgPerKeyPoint    << std::endl;
+        str << quote(NameTable::algorithms().name(algorithmId)) << tab
+            << timePerFrames / frames   << tab
+            << timePerKeyPoint / frames << std::endl;
     }
 
     return str << std::endl;
 }
 
-float average(const SingleRunStatistics& statistics, StatisticElement element)
+float average(const RunStatistics& statistics, StatisticElement element)
 {
-    std::vector<float> scores;
+    float  sum   = 0;
+    size_t count = 0;
 
-    for (size_t i = 0; i < statistics.size(); i++)
+    for (size_t i = 0; i < statistics.size; i++)
     {
         float value;
-        bool valid = statistics[i].tryGetValue(element, value);
-
-        if (valid)
+        if (statistics.tryGetValue(i, element, value))
         {
-            scores.push_back(value);
+            sum += value;
+            count++;
         }
     }
 
-    float sum     = std::accumulate(scores.begin(), scores.end(), 0.0f);
-    float average = sum / scores.size();
-    return average;
+    return sum / count;
 }
 
-float maximum(const SingleRunStatistics& statistics, StatisticElement element)
+float maximum(const RunStatistics& statistics, StatisticElement element)
 {
-    std::vector<float> scores;
+    float max   = 0;
+    bool  valid = false;
 
-    for (size_t i = 0; i < statistics.size(); i++)
+    for (size_t i = 0; i < statistics.size; i++)
     {
         float value;
-        bool valid = statistics[i].tryGetValue(element, value);
-
-        if (valid)
+        if (statistics.tryGetValue(i, element, value) && (!valid || value > max))
         {
-            scores.push_back(value);
+            max   = value;
+            valid = true;
         }
     }
 
-    assert(!scores.empty());
-
-    float max = *std::max_element(scores.begin(), scores.end());
+    assert(valid);
     return max;
 }
-
@@ -3,10 +3,17 @@
 
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <string>
 #include <opencv2/opencv.hpp>
 
+#include "RunningStatistics.hpp"
+#include "PerfCounters.hpp"
+#include "AllocationTracker.hpp"
+
 typedef enum
 {
     StatisticsElementPointsCount,
@@ -22,79 +29,261 @@ typedef enum
     StatisticsElementMemoryAllocated,
     StatisticsElementConsumedTimeMs,
     StatisticsElementConsumedTimeMsPerDescriptor,
-    StatisticsElementMemoryAllocatedPerDescriptor
+    StatisticsElementMemoryAllocatedPerDescriptor,
+    StatisticsElementPrecisionStdDev,
+    StatisticsElementRecallStdDev,
+    StatisticsElementConsumedTimeMsMean,
+    StatisticsElementConsumedTimeMsStdDev,
+    StatisticsElementConsumedTimeMsP50,
+    StatisticsElementConsumedTimeMsP95,
+    StatisticsElementConsumedTimeMsP99,
+    StatisticsElementDescribeCyclesPerDescriptor,
+    StatisticsElementDescribeInstructionsPerDescriptor,
+    StatisticsElementDescribeCacheMissesPerDescriptor,
+    StatisticsElementDescribeBranchMissesPerDescriptor,
+    StatisticsElementMatchCyclesPerDescriptor,
+    StatisticsElementMatchInstructionsPerDescriptor,
+    StatisticsElementMatchCacheMissesPerDescriptor,
+    StatisticsElementMatchBranchMissesPerDescriptor,
+    StatisticsElementAllocationsPerDescriptor,
+    StatisticsElementPeakMemory,
+    StatisticsElementMatchMemoryAllocatedPerDescriptor,
+    StatisticsElementMatchAllocationsPerDescriptor,
+    StatisticsElementMatchPeakMemory,
+    StatisticsElementRepeatability,
+    StatisticsElementMatchingScore
 } StatisticElement;
 
+//! Result of one frame of a run on a single image, as recorded by the evaluation. CollectedStatistics
+//! accumulates them into the sums and distributions of its cells.
 struct FrameMatchingStatistics
 {
     FrameMatchingStatistics();
 
-    std::string alg;
-    std::string trans;
-
     int totalKeypoints;
 
+    //! Keypoints of the frame if its descriptor extraction was measured by this run, otherwise 0; consumedTimeMs,
+    //! describeAllocations and describeCounters are only set for measured frames.
+    int measuredKeypoints;
+
     float argumentValue;
-    float percentOfMatches;
-    float ratioTestFalseLevel;
-    float meanDistance;
-    float stdDevDistance;
-    float matchingRatio;
-    float homographyError;
-    size_t memoryAllocated;
 
+    //! NaN if they are 0 / 0: precision of a frame without matches, recall of a frame without visible features.
     float recall;
     float precision;
 
+    //! Share of the keypoints in both images that are detected again, and that are correctly matched.
+    float repeatability;
+    float matchingScore;
+
     float consumedTimeMs;
-    cv::Scalar reprojectionError;
-    bool   isValid;
+    bool  isValid;
+
+    //! Heap usage of descriptor extraction and of matching on the evaluating thread.
+    AllocationCounts describeAllocations;
+    AllocationCounts matchAllocations;
+
+    //! Hardware events of descriptor extraction and of matching; empty unless counting is enabled.
+    PerfCounts describeCounters;
+    PerfCounts matchCounters;
 
-    // inline float matchingRatio()       const { return matchingRatio * percentOfMatches * 100.0f; };
-    // inline float patternLocalization() const { return matchingRatio * percentOfMatches * (1.0f - homographyError); }
+    //! Adds the result of matching this frame.
+    void addSample(int keypoints, float precision, float recall, float repeatability, float matchingScore,
+                   const AllocationCounts& matchAllocations, const PerfCounts& matchCounters);
 
-    std::ostream& writeElement(std::ostream& str, StatisticElement elem) const;
-    void getAlgTransInfo(std::string& alg, std::string& trans) const;
-    bool tryGetValue(StatisticElement element, float& value) const;
+    //! Adds the cost of extracting the descriptors of this frame. Only for costs measured by this run;
+    //! descriptors loaded from the feature cache have no cost that belongs to it.
+    void addDescribeCost(int keypoints, float timeMs, const AllocationCounts& describeAllocations, const PerfCounts& describeCounters);
 };
 
-typedef std::vector<FrameMatchingStatistics> SingleRunStatistics;
+//! Cells of a CollectedStatistics, one contiguous array per field, all indexed by the cell. Reports read only
+//! the arrays of the element they print, and no field keeps data on the heap, so merging cells does not allocate.
+struct StatisticsCells
+{
+    std::vector<float>                   argumentValue;
+    std::vector<unsigned char>           isValid;
+    std::vector<int>                     totalKeypoints;
+
+    //! Keypoints of the frames whose descriptor extraction was measured by this run; consumedTimeMs, the
+    //! extraction time distributions, describeAllocations and describeCounters only cover those frames.
+    std::vector<int>                     measuredKeypoints;
+    std::vector<float>                   consumedTimeMs;
+
+    //! Sums over the images whose precision or recall is defined, and the number of images where it is 0 / 0
+    //! and left out of the sums and the distributions.
+    std::vector<float>                   precision;
+    std::vector<float>                   recall;
+    std::vector<int>                     undefinedPrecisions;
+    std::vector<int>                     undefinedRecalls;
+
+    std::vector<float>                   repeatability;
+    std::vector<float>                   matchingScore;
+
+    //! Per-image distributions of precision, recall and descriptor extraction time.
+    std::vector<RunningStatistics>       precisionStats;
+    std::vector<RunningStatistics>       recallStats;
+    std::vector<RunningStatistics>       consumedTimeStats;
+    std::vector<BoundedLatencyHistogram> consumedTimeHistogram;
+
+    std::vector<AllocationCounts>        describeAllocations;
+    std::vector<AllocationCounts>        matchAllocations;
+    std::vector<PerfCounts>              describeCounters;
+    std::vector<PerfCounts>              matchCounters;
 
-float average(const SingleRunStatistics& statistics, StatisticElement element);
-float maximum(const SingleRunStatistics& statistics, StatisticElement element);
+    size_t size() const;
 
-struct Line
+    //! Resizes every array; new cells are empty.
+    void resize(size_t size);
+
+    //! Adds the result of a frame on one image to a cell.
+    void add(size_t cell, const FrameMatchingStatistics& frame);
+
+    //! Accumulates a cell of other, with the results of the same frame of other images, into a cell.
+    void merge(size_t cell, const StatisticsCells& other, size_t otherCell);
+
+    bool tryGetValue(size_t cell, StatisticElement element, float& value) const;
+};
+
+//! Frames of the run of one algorithm on one transformation, in the order of the arguments: the size cells
+//! from first on of a CollectedStatistics. A view, valid until it grows.
+struct RunStatistics
 {
-    float                                 argument;
-    std::vector<const FrameMatchingStatistics*> stats;
+    RunStatistics();
+    RunStatistics(const StatisticsCells* cells, size_t first, size_t size);
+
+    bool empty() const { return size == 0; }
+
+    //! Cell of the frame with the given index.
+    size_t cell(size_t index) const { return first + index; }
+
+    bool tryGetValue(size_t index, StatisticElement element, float& value) const
+    {
+        return cells->tryGetValue(first + index, element, value);
+    }
+
+    const StatisticsCells* cells;
+    size_t                 first;
+    size_t                 size;
 };
 
-struct GroupedByArgument
+float average(const RunStatistics& statistics, StatisticElement element);
+float maximum(const RunStatistics& statistics, StatisticElement element);
+
+//! Process-wide table of interned names. Statistics refer to algorithms and transformations by the small
+//! dense ids of their names, so that they are kept in arrays instead of maps keyed by strings.
+class NameTable
 {
-    std::vector<std::string> algorithms;
-    std::vector<Line>        lines;
+public:
+    static NameTable& algorithms();
+    static NameTable& transformations();
+
+    //! Id of the name, assigned on its first use. Ids are dense and start at 0.
+    int intern(const std::string& name);
+
+    //! The name of an id never changes and stays valid as long as the table. Does not lock, so that
+    //! reports can look up every name of their rows.
+    const std::string& name(int id) const;
+
+    //! Ids of all names, in the order of the names. Does not lock: the reference is only valid while no name is
+    //! interned, so call it from the main thread, which interns all names.
+    const std::vector<int>& sortedIds() const;
+
+    static const int MaxNames = 1024;
+
+private:
+    NameTable();
+    NameTable(const NameTable&);
+    NameTable& operator=(const NameTable&);
+
+    mutable std::mutex         m_lock;
+    std::deque<std::string>    m_names;
+    std::map<std::string, int> m_ids;
+    std::vector<int>           m_sortedIds;
+
+    //! Names by id, published after their element of m_names is complete
+    std::atomic<const std::string*> m_published[MaxNames];
 };
 
+//! Results of all runs as a dense cube [algorithm][transformation][argument], indexed by the interned ids of
+//! the names, with the cells kept as one array per field. The arguments of all transformations of an algorithm
+//! are contiguous, so that merging and printing walk the arrays in order. Tables list algorithms and transformations in the order of their names.
 class CollectedStatistics
 {
 public:
-    typedef std::map<std::string, const SingleRunStatistics*> InnerGroup;
-    typedef std::map<std::string, InnerGroup>                 OuterGroup;
-    typedef std::map<std::string, GroupedByArgument>          OuterGroupLine;
+    CollectedStatistics();
+
+    //! Adds the result of one frame of a run on one image. The cube grows to hold the run and the argument if
+    //! they are new, which moves all cells and invalidates views taken before.
+    void add(int algorithmId, int transformationId, size_t argumentIndex, const FrameMatchingStatistics& frame);
+
+    //! Frames of a run; empty if the run has no results.
+    RunStatistics run(int algorithmId, int transformationId) const;
 
-    SingleRunStatistics& getStatistics(std::string algorithmName, std::string transformationName);
+    //! Sizes of the algorithm and transformation axes; not every (algorithm, transformation) of them has a run.
+    int algorithmCount() const;
+    int transformationCount() const;
 
-    OuterGroup groupByAlgorithmThenByTransformation() const;
-    OuterGroupLine groupByTransformationThenByAlgorithm() const;
+    //! Accumulates the statistics of another set of runs, frame by frame.
+    void merge(const CollectedStatistics& other);
 
     std::ostream& printPerformanceStatistics(std::ostream& str) const;
     std::ostream& printStatistics(std::ostream& str, StatisticElement elem) const;
     std::ostream& printAverage(std::ostream& str, StatisticElement elem) const;
 
 private:
-    typedef std::pair<std::string, std::string> Key;
+    bool hasRun(int algorithmId, int transformationId) const;
+
+    //! Grows the axes to at least the given sizes and moves the cells to their new places.
+    void reshape(int algorithmCount, const std::vector<size_t>& argumentCounts);
+
+    //! Arguments of every transformation and the offset of its first in the cells of an algorithm
+    std::vector<size_t>                  m_argumentCounts;
+    std::vector<size_t>                  m_offsets;
+    size_t                               m_cellsPerAlgorithm;
+    int                                  m_algorithmCount;
+
+    //! Whether a run has results, [algorithm][transformation]
+    std::vector<unsigned char>           m_runs;
+    StatisticsCells                      m_cells;
+};
+
+//! Frame statistics recorded concurrently by the evaluating threads. Every thread appends to a shard of
+//! its own without locking; collect() merges the shards in the order of (algorithm, transformation, frame),
+//! which does not depend on the thread that recorded a frame, so the merged sums are the same on every run.
+class ShardedStatistics
+{
+public:
+    ShardedStatistics();
+
+    //! Records the statistics of the frame with the given index of the (algorithm, transformation) run.
+    void record(int algorithmId, int transformationId, size_t frameIndex, FrameMatchingStatistics frame);
+
+    //! Merges everything recorded so far into stat and empties the shards.
+    //! Must not run concurrently with record(), e.g. only after all evaluating tasks of an image are done.
+    void collect(CollectedStatistics& stat);
+
+private:
+    ShardedStatistics(const ShardedStatistics&);
+    ShardedStatistics& operator=(const ShardedStatistics&);
+
+    struct Record
+    {
+        int                     algorithmId;
+        int                     transformationId;
+        size_t                  frameIndex;
+        FrameMatchingStatistics frame;
+    };
+
+    // Padded to a cache line so that appends of neighbouring threads do not invalidate each other
+    struct Shard
+    {
+        std::vector<Record> records;
+        char                padding[64 - sizeof(std::vector<Record>) % 64];
+    };
+
+    static const int MaxShards = 256;
 
-    std::map<Key, SingleRunStatistics> m_allStats;
+    std::vector<Shard> m_shards;
 };
 
 #endif
@@ -0,0 +1,24 @@
+#include "PackedDataset.hpp"
+
+#include <iostream>
+
+//! Packs a folder of images into a single file of pre-decoded grayscale images that EvalFramework
+//! accepts in place of the folder.
+int main(int argc, const char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cout << "Usage: " << argv[0] << " Source Packed" << std::endl;
+        return 1;
+    }
+
+    size_t packedImages = 0;
+    if (!PackedDataset::pack(argv[1], argv[2], packedImages))
+    {
+        std::cout << "Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::cout << "Packed " << packedImages << " images into " << argv[2] << std::endl;
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "FeatureAlgorithm.hpp"
+#include "ThreadLocalPool.hpp"
+
+#include <opencv2/opencv.hpp>
+#include "opencv2/xfeatures2d.hpp"
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+//! Keypoints and descriptors of one algorithm on one image.
+struct Extraction
+{
+    Keypoints   keypoints;
+    Descriptors descriptors;
+};
+
+static void extract(const FeatureAlgorithm& algorithm, const cv::Mat& image, const Keypoints& keypoints, Extraction& result)
+{
+    int64 start, end;
+    AllocationCounts allocations;
+    PerfCounts counters;
+
+    result.keypoints = keypoints;
+    algorithm.extractDescriptors(image, result.keypoints, result.descriptors, start, end, allocations, counters);
+}
+
+static bool sameExtraction(const Extraction& a, const Extraction& b)
+{
+    if (a.keypoints.size() != b.keypoints.size())
+        return false;
+
+    for (size_t i = 0; i < a.keypoints.size(); i++)
+    {
+        const cv::KeyPoint& p = a.keypoints[i];
+        const cv::KeyPoint& q = b.keypoints[i];
+        if (p.pt != q.pt || p.size != q.size || p.angle != q.angle || p.octave != q.octave)
+            return false;
+    }
+
+    if (a.descriptors.size() != b.descriptors.size() || a.descriptors.type() != b.descriptors.type())
+        return false;
+
+    return a.descriptors.empty() || cv::norm(a.descriptors, b.descriptors, cv::NORM_INF) == 0;
+}
+
+//! Images given on the command line, or textured synthetic images with plenty of keypoints.
+static std::vector<cv::Mat> testImages(int argc, const char* argv[])
+{
+    std::vector<cv::Mat> images;
+
+    for (int i = 1; i < argc; i++)
+    {
+        cv::Mat image = cv::imread(argv[i], cv::IMREAD_GRAYSCALE);
+        if (image.empty())
+            std::cout << "Cannot read " << argv[i] << std::endl;
+        else
+            images.push_back(image);
+    }
+
+    if (argc > 1)
+        return images;
+
+    cv::RNG rng(0x5eed);
+    for (int i = 0; i < 3; i++)
+    {
+        cv::Mat image(480, 640, CV_8U);
+        rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+        cv::GaussianBlur(image, image, cv::Size(), 2 + i);
+        cv::normalize(image, image, 0, 255, cv::NORM_MINMAX);
+        images.push_back(image);
+    }
+
+    return images;
+}
+
+//! Extracts the descriptors of every algorithm on every image from all worker threads at once, and checks that
+//! the results are the same as extracting them on a single thread. Exits with a non-zero status if any differ.
+int main(int argc, const char* argv[])
+{
+    // Same setup as the evaluation: the parallelism comes from the calling threads only
+    cv::setNumThreads(1);
+
+    std::vector<FeatureAlgorithm> algorithms;
+    algorithms.push_back(FeatureAlgorithm("ORB",   [] { return cv::ORB::create(); },   true));
+    algorithms.push_back(FeatureAlgorithm("BRISK", [] { return cv::BRISK::create(); }, true));
+    algorithms.push_back(FeatureAlgorithm("SURF",  [] { return cv::xfeatures2d::SURF::create(); },  true));
+    algorithms.push_back(FeatureAlgorithm("FREAK",  [] { return cv::xfeatures2d::FREAK::create(); },  true));
+    algorithms.push_back(FeatureAlgorithm("SIFT",  [] { return cv::xfeatures2d::SIFT::create(); },  true));
+    algorithms.push_back(FeatureAlgorithm("BRIEF",  [] { return cv::xfeatures2d::BriefDescriptorExtractor::create(); },  true));
+    algorithms.push_back(FeatureAlgorithm("LATCH",  [] { return cv::xfeatures2d::LATCH::create(); },  true));
+
+    const std::vector<cv::Mat> images = testImages(argc, argv);
+    if (images.empty())
+        return 1;
+
+    std::vector<Keypoints> keypoints(images.size());
+    for (size_t i = 0; i < images.size(); i++)
+        FeatureAlgorithm::detector().detect(images[i], keypoints[i]);
+
+    // Reference results of a single thread, indexed by algorithm * images + image
+    const size_t jobs = algorithms.size() * images.size();
+    std::vector<Extraction> reference(jobs);
+    for (size_t j = 0; j < jobs; j++)
+        extract(algorithms[j / images.size()], images[j % images.size()], keypoints[j % images.size()], reference[j]);
+
+    const int threadCount = std::max(workerThreadCount(), 2);
+    const int rounds      = 4;
+
+    std::vector<std::atomic<int> > mismatches(algorithms.size());
+    for (size_t a = 0; a < algorithms.size(); a++)
+        mismatches[a] = 0;
+
+    // Every thread runs all jobs, starting at a different one, so that the same algorithm runs on several threads at once
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            Extraction result;
+            for (size_t k = 0; k < rounds * jobs; k++)
+            {
+                const size_t j = (k + t * jobs / threadCount) % jobs;
+                extract(algorithms[j / images.size()], images[j % images.size()], keypoints[j % images.size()], result);
+
+                if (!sameExtraction(reference[j], result))
+                    mismatches[j / images.size()]++;
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    std::cout << threadCount << " threads, " << images.size() << " images, " << rounds << " rounds" << std::endl;
+    std::cout << std::setw(10) << "Algorithm" << std::setw(12) << "Runs" << std::setw(12) << "Mismatches" << std::endl;
+
+    bool passed = true;
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        std::cout << std::setw(10) << algorithms[a].name << std::setw(12) << threadCount * rounds * images.size()
+                  << std::setw(12) << mismatches[a] << std::endl;
+        passed = passed && mismatches[a] == 0;
+    }
+
+    return passed ? 0 : 1;
+}
@@ -1,6 +1,11 @@
 #include "FeatureAlgorithm.hpp"
+#include "HammingMatcher.hpp"
+#include "L2Matcher.hpp"
+#include "MultiIndexHashing.hpp"
 #include "opencv2/xfeatures2d.hpp"
 #include <cassert>
+#include <cmath>
+#include <sstream>
 
 static cv::Ptr<cv::flann::IndexParams> indexParamsForDescriptorType(int descriptorType, int defaultNorm)
 {
@@ -27,26 +32,151 @@ cv::Ptr<cv::DescriptorMatcher> matcherForDescriptorType(int descriptorType, int
     }
 }
 
-FeatureAlgorithm::FeatureAlgorithm(const std::string& n, cv::Ptr<cv::Feature2D> fe, bool useBruteForceMather)
+//! In-tree matchers that stand in for OpenCV.
+typedef enum
+{
+    InTreeMatcherNone,
+    InTreeMatcherHamming,
+    InTreeMatcherMih,
+    InTreeMatcherL2
+} InTreeMatcher;
+
+static InTreeMatcher inTreeMatcher(MatcherBackend backend, int norm, const Descriptors& descriptors)
+{
+    if (backend == MatcherBackendSimd && norm == cv::NORM_HAMMING)
+        return InTreeMatcherHamming;
+
+    if (backend == MatcherBackendMih && norm == cv::NORM_HAMMING && MultiIndexHashing::supports(descriptors))
+        return InTreeMatcherMih;
+
+    if (backend == MatcherBackendSimd && norm == cv::NORM_L2 && descriptors.type() == CV_32F)
+        return InTreeMatcherL2;
+
+    return InTreeMatcherNone;
+}
+
+//! Nearest neighbours from index, converted to matches the way cv::FlannBasedMatcher does.
+static void flannMatch(cv::flann::Index& index, const Descriptors& query, Matches& matches)
+{
+    matches.clear();
+
+    if (query.empty())
+        return;
+
+    cv::Mat indices, distances;
+    index.knnSearch(query, indices, distances, 1, cv::flann::SearchParams());
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        const int j = indices.at<int>(i, 0);
+        if (j < 0)
+            continue;
+
+        // Hamming distances come as integers, L2 distances squared
+        const float distance = distances.type() == CV_32S ? static_cast<float>(distances.at<int>(i, 0))
+                                                           : std::sqrt(distances.at<float>(i, 0));
+        matches.push_back(cv::DMatch(i, j, 0, distance));
+    }
+}
+
+//! Nearest neighbours from index that pass the ratio test, without building the lists of cv::DMatch.
+static void flannRatioMatch(cv::flann::Index& index, const Descriptors& query, float maxRatio, Matches& matches)
+{
+    matches.clear();
+
+    if (query.empty())
+        return;
+
+    cv::Mat indices, distances;
+    index.knnSearch(query, indices, distances, 2, cv::flann::SearchParams());
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        const int j = indices.at<int>(i, 0);
+        if (j < 0 || indices.at<int>(i, 1) < 0)
+            continue;
+
+        float nearest, second;
+        if (distances.type() == CV_32S)
+        {
+            nearest = static_cast<float>(distances.at<int>(i, 0));
+            second  = static_cast<float>(distances.at<int>(i, 1));
+        }
+        else
+        {
+            nearest = std::sqrt(distances.at<float>(i, 0));
+            second  = std::sqrt(distances.at<float>(i, 1));
+        }
+
+        if (nearest < maxRatio * second)
+            matches.push_back(cv::DMatch(i, j, 0, nearest));
+    }
+}
+
+static std::string engineFingerprint(const std::string& name, const cv::Feature2D& engine)
+{
+    std::ostringstream fingerprint;
+    fingerprint << name << "|" << engine.getDefaultName()
+                << "|" << engine.descriptorSize() << "|" << engine.descriptorType() << "|" << engine.defaultNorm();
+
+    // Not every engine serializes its parameters, so this is a best effort
+    cv::FileStorage fs(".yml", cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+    engine.write(fs);
+    fingerprint << "|" << fs.releaseAndGetString();
+
+    return fingerprint.str();
+}
+
+FeatureAlgorithm::FeatureAlgorithm(const std::string& n, const FeatureEngineFactory& factory, bool useBruteForceMather,
+                                   MatcherBackend backend)
 : name(n)
 , knMatchSupported(false)
-, featureEngine(fe)
-, matcher(matcherForDescriptorType(fe->descriptorSize(), fe->defaultNorm(), useBruteForceMather))
+, maxRatio(0)
+, featureEngines(new ThreadLocalPool<cv::Feature2D>(factory))
+, matcher(matcherForDescriptorType(featureEngine().descriptorSize(), featureEngine().defaultNorm(), useBruteForceMather))
+, matcherBackend(backend)
+, descriptorNorm(featureEngine().defaultNorm())
+, flannIndexParams(useBruteForceMather ? cv::Ptr<cv::flann::IndexParams>()
+                                       : indexParamsForDescriptorType(featureEngine().descriptorSize(), featureEngine().defaultNorm()))
+{
+    fingerprint = engineFingerprint(name, featureEngine());
+}
+
+FeatureAlgorithm FeatureAlgorithm::withRatioTest(float ratio) const
+{
+    FeatureAlgorithm variant(*this);
+    variant.name             = name + "+Ratio";
+    variant.knMatchSupported = true;
+    variant.maxRatio         = ratio;
+
+    // Cross check limits cv::BFMatcher to a single neighbour
+    if (!flannIndexParams)
+        variant.matcher = cv::Ptr<cv::DescriptorMatcher>(new cv::BFMatcher(descriptorNorm, false));
+
+    return variant;
+}
+
+cv::Feature2D& FeatureAlgorithm::detector()
+{
+    static ThreadLocalPool<cv::Feature2D> detectors([] { return cv::xfeatures2d::SURF::create(); });
+    return detectors.local();
+}
+
+cv::Feature2D& FeatureAlgorithm::featureEngine() const
 {
-    CV_Assert(fe);
+    return featureEngines->local();
 }
 
 
 bool FeatureAlgorithm::extractFeatures(const cv::Mat& image, Keypoints& kp, Descriptors& desc) const
 {
     assert(!image.empty());
-    cv::Ptr<cv::Feature2D> surf_detector = cv::xfeatures2d::SURF::create();
-    surf_detector->detect(image, kp);
+    detector().detect(image, kp);
 
     if (kp.empty())
         return false;
 
-    featureEngine->compute(image, kp, desc);
+    featureEngine().compute(image, kp, desc);
 
     return kp.size() > 0;
 }
@@ -54,17 +184,36 @@ bool FeatureAlgorithm::extractFeatures(const cv::Mat& image, Keypoints& kp, Desc
 bool FeatureAlgorithm::extractFeatures(const cv::Mat& image, Keypoints& kp, Descriptors& desc, int64& start, int64& end, size_t& memoryAllocated) const
 {
     assert(!image.empty());
-    cv::Ptr<cv::Feature2D> surf_detector = cv::xfeatures2d::SURF::create();
-    surf_detector->detect(image, kp);
+    detector().detect(image, kp);
+
+    if (kp.empty())
+        return false;
+
+    AllocationCounts allocations;
+    AllocationScope allocationScope;
+    start = cv::getTickCount();
+    featureEngine().compute(image, kp, desc);
+    end = cv::getTickCount();
+    allocationScope.stop(allocations);
+    memoryAllocated = allocations.bytes;
+
+    return kp.size() > 0;
+}
+
+bool FeatureAlgorithm::extractDescriptors(const cv::Mat& image, Keypoints& kp, Descriptors& desc, int64& start, int64& end, AllocationCounts& allocations, PerfCounts& counters) const
+{
+    assert(!image.empty());
 
     if (kp.empty())
         return false;
 
+    PerfSection section;
+    AllocationScope allocationScope;
     start = cv::getTickCount();
-    //cv::clearMemoryAllocated(); // Only works with custom compiled OpenCV version
-    featureEngine->compute(image, kp, desc);
-    //memoryAllocated = cv::getAmountOfMemoryAllocated(); // Only works with custom compiled OpenCV version
+    featureEngine().compute(image, kp, desc);
     end = cv::getTickCount();
+    allocationScope.stop(allocations);
+    section.stop(counters, kp.size());
 
     return kp.size() > 0;
 }
@@ -72,15 +221,127 @@ bool FeatureAlgorithm::extractFeatures(const cv::Mat& image, Keypoints& kp, Desc
 Descriptors FeatureAlgorithm::getDescriptors(const cv::Mat& image, Keypoints& kp) const
 {
     Descriptors desc;
-    featureEngine->compute(image, kp, desc);
+    featureEngine().compute(image, kp, desc);
     return desc;
 }
 
 void FeatureAlgorithm::matchFeatures(const Descriptors& train, const Descriptors& query, Matches& matches) const
 {
+    switch (inTreeMatcher(matcherBackend, descriptorNorm, query))
+    {
+    case InTreeMatcherHamming:
+        HammingMatcher::crossCheckMatch(query, train, matches);
+        return;
+
+    case InTreeMatcherMih:
+        MultiIndexHashing::crossCheckMatch(query, train, matches);
+        return;
+
+    case InTreeMatcherL2:
+        if (train.type() == CV_32F)
+        {
+            L2Matcher::crossCheckMatch(query, train, matches);
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
     matcher->match(query, train, matches);
 }
 
+void FeatureAlgorithm::prepareTrainSet(const Descriptors& train, PreparedTrainSet& prepared) const
+{
+    prepared = PreparedTrainSet();
+    prepared.descriptors = train;
+
+    if (train.empty())
+        return;
+
+    // Ratio variants matched by brute force go through the in-tree matchers whatever the backend
+    if (knMatchSupported && !flannIndexParams)
+    {
+        if (descriptorNorm == cv::NORM_L2)
+            L2Matcher::prepare(train, prepared.l2);
+        else if (matcherBackend == MatcherBackendMih && MultiIndexHashing::indexPays(train))
+            prepared.mih = cv::Ptr<MultiIndexHashing>(new MultiIndexHashing(train));
+
+        return;
+    }
+
+    // The Hamming and multi-index hashing matchers have nothing to prepare: both read the rows in
+    // place, and the latter indexes the query set, which changes with every call.
+    switch (inTreeMatcher(matcherBackend, descriptorNorm, train))
+    {
+    case InTreeMatcherL2:
+        L2Matcher::prepare(train, prepared.l2);
+        break;
+
+    case InTreeMatcherNone:
+        if (flannIndexParams)
+            prepared.flannIndex = cv::Ptr<cv::flann::Index>(new cv::flann::Index(train, *flannIndexParams));
+        break;
+
+    default:
+        break;
+    }
+}
+
+void FeatureAlgorithm::matchFeatures(const PreparedTrainSet& train, const Descriptors& query, Matches& matches) const
+{
+    const InTreeMatcher inTree = inTreeMatcher(matcherBackend, descriptorNorm, query);
+
+    if (inTree == InTreeMatcherL2 && !train.l2.descriptors.empty())
+    {
+        L2Matcher::crossCheckMatch(query, train.l2, matches);
+        return;
+    }
+
+    // Searching does not modify the index, so it is safe from any number of threads
+    if (inTree == InTreeMatcherNone && train.flannIndex)
+    {
+        flannMatch(*train.flannIndex, query, matches);
+        return;
+    }
+
+    matchFeatures(train.descriptors, query, matches);
+}
+
+void FeatureAlgorithm::ratioMatchFeatures(const PreparedTrainSet& train, const Descriptors& query, Matches& matches) const
+{
+    assert(knMatchSupported);
+
+    // Searching does not modify the indices, so it is safe from any number of threads
+    if (train.flannIndex)
+    {
+        flannRatioMatch(*train.flannIndex, query, maxRatio, matches);
+        return;
+    }
+
+    if (train.mih)
+    {
+        train.mih->ratioMatch(query, maxRatio, matches);
+        return;
+    }
+
+    switch (descriptorNorm)
+    {
+    case cv::NORM_L2:
+        CV_Assert(train.descriptors.empty() || !train.l2.descriptors.empty());
+        L2Matcher::ratioMatch(query, train.l2, maxRatio, matches);
+        break;
+
+    case cv::NORM_HAMMING:
+        HammingMatcher::ratioMatch(query, train.descriptors, maxRatio, matches);
+        break;
+
+    default:
+        CV_Assert(false && "Unsupported descriptor norm");
+    }
+}
+
 void FeatureAlgorithm::matchFeatures(const Descriptors& train, const Descriptors& query, int k, std::vector<Matches>& matches) const
 {
     assert(knMatchSupported);
@@ -1,44 +1,115 @@
 #ifndef FeatureAlgorithm_hpp
 #define FeatureAlgorithm_hpp
 
+#include "ThreadLocalPool.hpp"
+#include "PerfCounters.hpp"
+#include "AllocationTracker.hpp"
+#include "L2Matcher.hpp"
+#include "MultiIndexHashing.hpp"
 #include <opencv2/opencv.hpp>
 
 typedef std::vector<cv::KeyPoint> Keypoints;
 typedef cv::Mat                   Descriptors;
 typedef std::vector<cv::DMatch>   Matches;
 
+//! Creates a new, independent instance of a feature engine.
+typedef std::function<cv::Ptr<cv::Feature2D>()> FeatureEngineFactory;
+
+//! Implementation used to match descriptors.
+typedef enum
+{
+    //! cv::BFMatcher with cross check, or FLANN if brute force matching is disabled.
+    MatcherBackendOpenCV,
+
+    //! In-tree vectorized brute force matchers with cross check; OpenCV for descriptors they do not cover.
+    MatcherBackendSimd,
+
+    //! Exact multi-index hashing with cross check for binary descriptors; OpenCV for the others.
+    MatcherBackendMih
+} MatcherBackend;
+
+//! Train descriptors that are matched against many query sets, with the work the matcher can do on
+//! them up front: the FLANN index, the packed rows and norms of the L2 matcher, or the multi-index
+//! hashing index of the ratio test. Only read once built, so one instance can be shared by all threads.
+struct PreparedTrainSet
+{
+    Descriptors                 descriptors;
+    cv::Ptr<cv::flann::Index>   flannIndex;
+    L2Matcher::PreparedTrain    l2;
+    cv::Ptr<MultiIndexHashing>  mih;
+};
+
 //! Represents combination of feature detector, descriptor extractor and matcher algorithms for test
 class FeatureAlgorithm
 {
 public:
-    explicit FeatureAlgorithm(const std::string& name, cv::Ptr<cv::Feature2D> featureEngine, bool useBruteForceMather);
+    //! The factory is used to create one feature engine per thread.
+    explicit FeatureAlgorithm(const std::string& name, const FeatureEngineFactory& featureEngineFactory, bool useBruteForceMather,
+                              MatcherBackend matcherBackend = MatcherBackendOpenCV);
 
     //! Human-friendly name of detection/extraction/matcher combination.
     std::string name;
 
+    //! Name, type and parameters of the feature engine; identifies its results in the feature cache.
+    std::string fingerprint;
+
     //! If true, a KNN-matching and ratio test will be enabled for matching descriptors.
     bool knMatchSupported;
 
+    //! Largest accepted ratio of the nearest to the second nearest distance when knMatchSupported is set.
+    float maxRatio;
+
+    //! Same detection and extraction, matched by the two nearest neighbours and the ratio test instead
+    //! of cross check. Named name + "+Ratio" in the statistics; shares the feature cache entries.
+    FeatureAlgorithm withRatioTest(float maxRatio) const;
+
     //! Extracts feature points and compute descriptors from given image.
     bool extractFeatures(const cv::Mat& image, Keypoints& kp, Descriptors& desc) const;
 
     //! Extracts feature points and compute descriptors from given image and measure the time consumed for computing the features.
     bool extractFeatures(const cv::Mat& image, Keypoints& kp, Descriptors& desc, int64& start, int64& end, size_t& memoryAllocated) const;
 
+    //! Computes descriptors for already detected feature points and measures the time consumed for computing them.
+    //! Heap allocations of the computation are added to allocations, and its hardware events to counters
+    //! when counting is enabled.
+    bool extractDescriptors(const cv::Mat& image, Keypoints& kp, Descriptors& desc, int64& start, int64& end, AllocationCounts& allocations, PerfCounts& counters) const;
+
     //! Finds correspondences using regular match.
     void matchFeatures(const Descriptors& train, const Descriptors& query, Matches& matches) const;
 
+    //! Prepares train for repeated matching with the configured matcher.
+    void prepareTrainSet(const Descriptors& train, PreparedTrainSet& prepared) const;
+
+    //! Same as matching against prepared.descriptors, without rebuilding the matcher's index.
+    void matchFeatures(const PreparedTrainSet& train, const Descriptors& query, Matches& matches) const;
+
+    //! Nearest neighbours of query in train that pass the ratio test, with the test done while searching
+    //! for the two nearest: by FLANN if brute force matching is disabled, and otherwise by the in-tree
+    //! Hamming or L2 matcher whatever the backend, or the multi-index hashing one where it pays.
+    void ratioMatchFeatures(const PreparedTrainSet& train, const Descriptors& query, Matches& matches) const;
+
     //! KNN match features.
     void matchFeatures(const Descriptors& train, const Descriptors& query, int k, std::vector<Matches>& matches) const;
 
     Descriptors getDescriptors(const cv::Mat& image, Keypoints& kp) const;
 
+    //! SURF detector used for the source images and all transformed frames, owned by the calling thread.
+    static cv::Feature2D& detector();
+
 private:
-    cv::Ptr<cv::Feature2D>           featureEngine;
+    //! Calling thread's feature engine.
+    cv::Feature2D& featureEngine() const;
+
+    cv::Ptr<ThreadLocalPool<cv::Feature2D> > featureEngines;
 
-    cv::Ptr<cv::FeatureDetector>     detector;
     cv::Ptr<cv::DescriptorExtractor> extractor;
     cv::Ptr<cv::DescriptorMatcher>   matcher;
+
+    MatcherBackend                   matcherBackend;
+    int                              descriptorNorm;
+
+    //! Index parameters of the FLANN matcher; empty when matching by brute force.
+    cv::Ptr<cv::flann::IndexParams>  flannIndexParams;
 };
 
 #endif
\ No newline at end of file
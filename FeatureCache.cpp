@@ -0,0 +1,254 @@
+#include "FeatureCache.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace fs = boost::filesystem;
+namespace ipc = boost::interprocess;
+
+namespace
+{
+    const char     CacheMagic[8] = { 'E', 'F', 'C', 'A', 'C', 'H', 'E', '1' };
+    // 4: rotations are warped through a fixed-point projective map, which changes their frames
+    // 5: the cost of computing the descriptors is no longer stored
+    const uint32_t CacheVersion  = 5;
+
+    // Bumped whenever the pixels of transformed frames change for the same transformation and argument
+    // (2: blur levels up to kernel size 7 blurred directly, 3: combined down-scales in two passes)
+    const uint32_t FrameVersion  = 3;
+
+    struct CacheFileHeader
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t keyLength;
+        uint32_t keypointCount;
+        int32_t  descriptorRows;
+        int32_t  descriptorCols;
+        int32_t  descriptorType;
+        uint64_t descriptorOffset;
+    };
+
+    struct KeypointRecord
+    {
+        float   x, y, size, angle, response;
+        int32_t octave, classId;
+    };
+
+    const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+    const uint64_t FnvPrime       = 1099511628211ULL;
+
+    uint64_t fnv1a(const unsigned char* data, size_t length, uint64_t hash = FnvOffsetBasis)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= data[i];
+            hash *= FnvPrime;
+        }
+        return hash;
+    }
+
+    std::string toHex(uint64_t value)
+    {
+        std::ostringstream str;
+        str << std::hex << std::setw(16) << std::setfill('0') << value;
+        return str.str();
+    }
+
+    // Descriptors start at a 16 byte boundary so that they can be used straight from the mapping
+    uint64_t descriptorOffset(size_t keyLength, size_t keypointCount)
+    {
+        uint64_t offset = sizeof(CacheFileHeader) + keyLength + keypointCount * sizeof(KeypointRecord);
+        return (offset + 15) & ~uint64_t(15);
+    }
+}
+
+FeatureCache::FeatureCache(const std::string& directory)
+: m_directory(directory)
+{
+    if (!m_directory.empty())
+        fs::create_directories(m_directory);
+}
+
+bool FeatureCache::isEnabled() const
+{
+    return !m_directory.empty();
+}
+
+uint64 FeatureCache::hashImage(const cv::Mat& image)
+{
+    int header[3] = { image.rows, image.cols, image.type() };
+    uint64_t hash = fnv1a(reinterpret_cast<const unsigned char*>(header), sizeof(header));
+
+    const size_t rowBytes = image.cols * image.elemSize();
+    for (int y = 0; y < image.rows; y++)
+        hash = fnv1a(image.ptr<unsigned char>(y), rowBytes, hash);
+
+    return hash;
+}
+
+std::string FeatureCache::frameKey(uint64 imageHash, const std::string& transformationFingerprint, float argument)
+{
+    std::ostringstream key;
+    key << toHex(imageHash) << "|frames" << FrameVersion << "|" << transformationFingerprint << "|" << std::setprecision(9) << argument;
+    return key.str();
+}
+
+std::string FeatureCache::entryPath(const std::string& key) const
+{
+    std::string name = toHex(fnv1a(reinterpret_cast<const unsigned char*>(key.data()), key.size()));
+
+    // Fan out over 256 sub-directories to keep directory sizes manageable
+    return (fs::path(m_directory) / name.substr(0, 2) / name.substr(2)).string();
+}
+
+bool FeatureCache::load(const std::string& frameKey, const std::string& producer, CachedFeatures& features) const
+{
+    if (!isEnabled())
+        return false;
+
+    const std::string key  = frameKey + "|" + producer;
+    const std::string path = entryPath(key);
+
+    if (!fs::exists(path))
+        return false;
+
+    try
+    {
+        ipc::file_mapping  file(path.c_str(), ipc::read_only);
+        ipc::mapped_region region(file, ipc::read_only);
+
+        const unsigned char* data = static_cast<const unsigned char*>(region.get_address());
+        const size_t size = region.get_size();
+
+        if (size < sizeof(CacheFileHeader))
+            return false;
+
+        CacheFileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion)
+            return false;
+
+        // Guard against hash collisions between different keys
+        if (header.keyLength != key.size() || sizeof(header) + key.size() > size ||
+            std::memcmp(data + sizeof(header), key.data(), key.size()) != 0)
+            return false;
+
+        // Truncated or corrupted entries are misses; the descriptor matrix is only allocated once its
+        // shape and type are known to be valid and its bytes to be in the file
+        const int descriptorDepth = CV_MAT_DEPTH(header.descriptorType);
+        if (header.descriptorRows < 0 || header.descriptorCols < 0 ||
+            (header.descriptorType & ~CV_MAT_TYPE_MASK) != 0 || descriptorDepth > CV_64F)
+            return false;
+
+        if (header.descriptorOffset != descriptorOffset(key.size(), header.keypointCount) || header.descriptorOffset > size)
+            return false;
+
+        const uint64_t availableBytes = size - header.descriptorOffset;
+        const uint64_t rowBytes       = uint64_t(header.descriptorCols) * CV_ELEM_SIZE(header.descriptorType);
+
+        cv::Mat descriptors;
+        if (header.descriptorRows > 0)
+        {
+            if (rowBytes == 0 || rowBytes > availableBytes / header.descriptorRows)
+                return false;
+
+            descriptors = cv::Mat(header.descriptorRows, header.descriptorCols, header.descriptorType);
+        }
+
+        const size_t descriptorBytes = descriptors.total() * descriptors.elemSize();
+
+        const KeypointRecord* records = reinterpret_cast<const KeypointRecord*>(data + sizeof(header) + key.size());
+
+        features.keypoints.resize(header.keypointCount);
+        for (size_t i = 0; i < header.keypointCount; i++)
+        {
+            KeypointRecord r;
+            std::memcpy(&r, records + i, sizeof(r));
+            features.keypoints[i] = cv::KeyPoint(cv::Point2f(r.x, r.y), r.size, r.angle, r.response, r.octave, r.classId);
+        }
+
+        if (descriptorBytes > 0)
+            std::memcpy(descriptors.data, data + header.descriptorOffset, descriptorBytes);
+
+        features.descriptors = descriptors;
+
+        return true;
+    }
+    catch (const ipc::interprocess_exception&)
+    {
+        return false;
+    }
+    catch (const cv::Exception&)
+    {
+        return false;
+    }
+}
+
+void FeatureCache::store(const std::string& frameKey, const std::string& producer, const CachedFeatures& features) const
+{
+    if (!isEnabled())
+        return;
+
+    const std::string key  = frameKey + "|" + producer;
+    const std::string path = entryPath(key);
+
+    cv::Mat descriptors = features.descriptors.isContinuous() ? features.descriptors : features.descriptors.clone();
+
+    CacheFileHeader header;
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version          = CacheVersion;
+    header.keyLength        = key.size();
+    header.keypointCount    = features.keypoints.size();
+    header.descriptorRows   = descriptors.rows;
+    header.descriptorCols   = descriptors.cols;
+    header.descriptorType   = descriptors.type();
+    header.descriptorOffset = descriptorOffset(key.size(), features.keypoints.size());
+
+    std::vector<KeypointRecord> records(features.keypoints.size());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const cv::KeyPoint& kp = features.keypoints[i];
+        KeypointRecord r = { kp.pt.x, kp.pt.y, kp.size, kp.angle, kp.response, kp.octave, kp.class_id };
+        records[i] = r;
+    }
+
+    try
+    {
+        fs::create_directories(fs::path(path).parent_path());
+
+        // Random, so that neither other threads nor other processes sharing the cache write the same file
+        const fs::path tempPath = fs::unique_path(path + ".%%%%-%%%%-%%%%-%%%%.tmp");
+
+        std::ofstream out(tempPath.string().c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(key.data(), key.size());
+
+        if (!records.empty())
+            out.write(reinterpret_cast<const char*>(&records[0]), records.size() * sizeof(KeypointRecord));
+
+        const uint64_t written = sizeof(header) + key.size() + records.size() * sizeof(KeypointRecord);
+        const char padding[16] = { 0 };
+        out.write(padding, header.descriptorOffset - written);
+
+        if (!descriptors.empty())
+            out.write(reinterpret_cast<const char*>(descriptors.data), descriptors.total() * descriptors.elemSize());
+
+        out.close();
+
+        if (out)
+            fs::rename(tempPath, path);
+        else
+            fs::remove(tempPath);
+    }
+    catch (const fs::filesystem_error& e)
+    {
+        std::cout << "Cannot store cache entry " << path << ": " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef FeatureCache_hpp
+#define FeatureCache_hpp
+
+#include "FeatureAlgorithm.hpp"
+#include <string>
+
+//! Keypoints and descriptors of one frame.
+struct CachedFeatures
+{
+    Keypoints   keypoints;
+    Descriptors descriptors;
+};
+
+//! Persistent, content-addressed cache of keypoints and descriptors. Every entry is a separate
+//! binary file in the cache directory, named after the hash of its key, and is read back through
+//! a memory mapping. Keys combine the content hash of the source image, the transformation fingerprint
+//! and argument, the version of the frame generation, how the keypoints were obtained and the algorithm fingerprint.
+class FeatureCache
+{
+public:
+    //! An empty directory disables the cache: nothing is loaded or stored.
+    explicit FeatureCache(const std::string& directory = std::string());
+
+    bool isEnabled() const;
+
+    //! Hash of the image size, type and pixel data.
+    static uint64 hashImage(const cv::Mat& image);
+
+    //! Identifies a frame derived from the image with the given hash by the transformation with the given
+    //! fingerprint (ImageTransformation::fingerprint). An empty fingerprint denotes the source image itself.
+    static std::string frameKey(uint64 imageHash, const std::string& transformationFingerprint, float argument);
+
+    //! Loads the entry produced for the given frame by the given detector or algorithm fingerprint.
+    bool load(const std::string& frameKey, const std::string& producer, CachedFeatures& features) const;
+
+    //! Stores an entry; the file is written to a temporary name first and then renamed, so that
+    //! concurrent readers and crashes never see a partially written entry.
+    void store(const std::string& frameKey, const std::string& producer, const CachedFeatures& features) const;
+
+private:
+    std::string entryPath(const std::string& key) const;
+
+    std::string m_directory;
+};
+
+#endif
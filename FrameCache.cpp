@@ -0,0 +1,163 @@
+#include "FrameCache.hpp"
+#include "FeatureAlgorithm.hpp"
+#include "StageProfiler.hpp"
+#include "CollectedStatistics.hpp"
+
+FrameCache::FrameCache(const FeatureCache& featureCache, bool projectSourceKeypoints)
+: m_featureCache(featureCache)
+, m_projectSourceKeypoints(projectSourceKeypoints)
+, m_sourceImageHash(0)
+{
+}
+
+void FrameCache::prepare(const cv::Mat& sourceImage,
+                         uint64 sourceImageHash,
+                         const Keypoints& sourceKp,
+                         const std::vector<cv::Ptr<ImageTransformation> >& transformations)
+{
+    m_sourceImage     = sourceImage;
+    m_sourceImageHash = sourceImageHash;
+    m_sourceKp        = sourceKp;
+    m_transformations = transformations;
+    m_fingerprints.resize(transformations.size());
+    m_transformationIds.resize(transformations.size());
+    cv::KeyPoint::convert(m_sourceKp, m_sourcePoints);
+
+    m_frames.clear();
+    m_frames.resize(transformations.size());
+    m_warpJobs.clear();
+
+    for (size_t transformIndex = 0; transformIndex < transformations.size(); transformIndex++)
+    {
+        std::vector<float> x = transformations[transformIndex]->getX();
+        m_frames[transformIndex].resize(x.size());
+        m_fingerprints[transformIndex] = transformations[transformIndex]->fingerprint();
+        m_transformationIds[transformIndex] = NameTable::transformations().intern(transformations[transformIndex]->name);
+
+        for (size_t i = 0; i < x.size(); i++)
+            m_frames[transformIndex][i].argument = x[i];
+
+        // Incremental sweeps are generated in one pass by a single job, other frames are warped by a job each
+        if (transformations[transformIndex]->incrementalSweep())
+        {
+            WarpJob job = { transformIndex, -1 };
+            m_warpJobs.push_back(job);
+            continue;
+        }
+
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            WarpJob job = { transformIndex, static_cast<int>(i) };
+            m_warpJobs.push_back(job);
+        }
+    }
+}
+
+const std::vector<FrameCache::WarpJob>& FrameCache::warpJobs() const
+{
+    return m_warpJobs;
+}
+
+void FrameCache::warp(size_t job)
+{
+    const WarpJob& warpJob = m_warpJobs[job];
+    const ImageTransformation& transformation = *m_transformations[warpJob.transformIndex];
+    std::vector<TransformedFrame>& sweep = m_frames[warpJob.transformIndex];
+
+    ScopedStageTimer timer(StageWarp, StageProfiler::AnyName, m_transformationIds[warpJob.transformIndex]);
+
+    if (warpJob.frameIndex >= 0)
+    {
+        TransformedFrame& frame = sweep[warpJob.frameIndex];
+        transformation.transform(frame.argument, m_sourceImage, frame.image);
+    }
+    else
+    {
+        std::vector<cv::Mat> images;
+        transformation.transformSweep(m_sourceImage, images);
+
+        CV_Assert(images.size() == sweep.size());
+        for (size_t i = 0; i < sweep.size(); i++)
+            sweep[i].image = images[i];
+    }
+}
+
+void FrameCache::completeFrame(size_t transformIndex, size_t frameIndex)
+{
+    const ImageTransformation& transformation = *m_transformations[transformIndex];
+    TransformedFrame& frame = m_frames[transformIndex][frameIndex];
+
+    frame.cacheKey = FeatureCache::frameKey(m_sourceImageHash, m_fingerprints[transformIndex], frame.argument)
+                   + (m_projectSourceKeypoints ? "|projected SURF" : "|SURF");
+
+    if (m_projectSourceKeypoints)
+    {
+        Keypoints projected;
+        transformation.transform(frame.argument, m_sourceImage.size(), m_sourceKp, projected);
+
+        for (size_t k = 0; k < projected.size(); k++)
+        {
+            const cv::Point2f& pt = projected[k].pt;
+            if (pt.x > 0 && pt.y > 0 && pt.x < frame.image.cols && pt.y < frame.image.rows)
+                frame.keypoints.push_back(projected[k]);
+        }
+    }
+    else
+    {
+        CachedFeatures cached;
+        if (m_featureCache.load(frame.cacheKey, "keypoints", cached))
+        {
+            frame.keypoints = cached.keypoints;
+        }
+        else
+        {
+            ScopedStageTimer timer(StageDetect, StageProfiler::AnyName, m_transformationIds[transformIndex]);
+            FeatureAlgorithm::detector().detect(frame.image, frame.keypoints);
+
+            cached.keypoints = frame.keypoints;
+            m_featureCache.store(frame.cacheKey, "keypoints", cached);
+        }
+    }
+
+    frame.expectedHomography = transformation.homographies(m_sourceImage.size())[frameIndex];
+
+    if (!m_sourcePoints.empty())
+        cv::perspectiveTransform(m_sourcePoints, frame.sourcePointsInFrame, frame.expectedHomography);
+}
+
+const std::vector<TransformedFrame>& FrameCache::frames(size_t transformIndex) const
+{
+    return m_frames[transformIndex];
+}
+
+void FrameCache::clear()
+{
+    m_frames.clear();
+    m_warpJobs.clear();
+    m_sourceImage.release();
+    m_sourceKp.clear();
+    m_sourcePoints.clear();
+}
+
+std::vector<int> FrameCache::subsetIndices(const Keypoints& all, const Keypoints& subset)
+{
+    std::vector<int> indices(subset.size(), -1);
+
+    size_t j = 0;
+    for (size_t i = 0; i < subset.size(); i++)
+    {
+        const cv::KeyPoint& kp = subset[i];
+
+        size_t k = j;
+        while (k < all.size() && (all[k].pt.x != kp.pt.x || all[k].pt.y != kp.pt.y))
+            k++;
+
+        if (k < all.size())
+        {
+            indices[i] = k;
+            j = k + 1;
+        }
+    }
+
+    return indices;
+}
@@ -0,0 +1,85 @@
+#ifndef FrameCache_hpp
+#define FrameCache_hpp
+
+#include "ImageTransformation.hpp"
+#include "FeatureCache.hpp"
+
+//! Everything about a single transformed frame that does not depend on the evaluated algorithm.
+struct TransformedFrame
+{
+    float                    argument;
+    cv::Mat                  image;
+
+    //! Keypoints detected on the transformed image, or the projected source keypoints
+    //! that fall inside it if the cache was built with projected keypoints.
+    Keypoints                keypoints;
+
+    cv::Matx33d              expectedHomography;
+
+    //! Identifies the frame and the origin of its keypoints in the feature cache.
+    std::string              cacheKey;
+
+    //! Source keypoints projected into the transformed image using expectedHomography.
+    std::vector<cv::Point2f> sourcePointsInFrame;
+};
+
+//! Transformed frames of one source image for every (transformation, argument) pair.
+//! The cache is built once per image and then consumed read-only by every algorithm. Building is split
+//! into warp jobs and the completion of single frames, so that they can run as separate tasks.
+class FrameCache
+{
+public:
+    //! A warp of the source image into one frame, or into all frames of an incremental sweep (frame -1).
+    struct WarpJob
+    {
+        size_t transformIndex;
+        int    frameIndex;
+    };
+
+    //! If projectSourceKeypoints is true, no detection is run on the transformed frames; the source
+    //! keypoints are mapped into every frame analytically so that only descriptor performance is measured.
+    //! Keypoints detected on the transformed frames are looked up in and added to featureCache.
+    FrameCache(const FeatureCache& featureCache, bool projectSourceKeypoints);
+
+    //! Sets up the frames of all transformations of the source image and lists the warp jobs; nothing is computed yet.
+    void prepare(const cv::Mat& sourceImage,
+                 uint64 sourceImageHash,
+                 const Keypoints& sourceKp,
+                 const std::vector<cv::Ptr<ImageTransformation> >& transformations);
+
+    const std::vector<WarpJob>& warpJobs() const;
+
+    //! Runs the warp job with the given index. Different jobs can run concurrently.
+    void warp(size_t job);
+
+    //! Detects or projects the keypoints of a warped frame and projects the source keypoints into it.
+    //! Different frames can be completed concurrently.
+    void completeFrame(size_t transformIndex, size_t frameIndex);
+
+    //! Frames of the transformation with the given index, in the order of its getX().
+    const std::vector<TransformedFrame>& frames(size_t transformIndex) const;
+
+    void clear();
+
+    //! For every keypoint of subset returns its index in all, assuming that subset was obtained by
+    //! removing elements from all without reordering (which is what Feature2D::compute does).
+    //! Keypoints that cannot be found get index -1.
+    static std::vector<int> subsetIndices(const Keypoints& all, const Keypoints& subset);
+
+private:
+    const FeatureCache&                          m_featureCache;
+    bool                                         m_projectSourceKeypoints;
+
+    cv::Mat                                      m_sourceImage;
+    uint64                                       m_sourceImageHash;
+    Keypoints                                    m_sourceKp;
+    std::vector<cv::Point2f>                     m_sourcePoints;
+    std::vector<cv::Ptr<ImageTransformation> >   m_transformations;
+    std::vector<int>                             m_transformationIds;
+    std::vector<std::string>                     m_fingerprints;
+
+    std::vector< std::vector<TransformedFrame> > m_frames;
+    std::vector<WarpJob>                         m_warpJobs;
+};
+
+#endif
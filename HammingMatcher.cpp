@@ -0,0 +1,344 @@
+#include "HammingMatcher.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAMMING_X86_KERNELS 1
+#endif
+
+typedef void (*DistanceKernel)(const uchar* descriptor, const uchar* rows, size_t step, int count, int bytes, int* result);
+
+static inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Hamming distance of bytes [from, bytes) of a and b
+static inline int hammingTail(const uchar* a, const uchar* b, int from, int bytes)
+{
+    int distance = 0;
+    int k = from;
+
+    for (; k + 8 <= bytes; k += 8)
+    {
+        uint64_t x, y;
+        std::memcpy(&x, a + k, sizeof(x));
+        std::memcpy(&y, b + k, sizeof(y));
+        distance += popcount64(x ^ y);
+    }
+
+    for (; k < bytes; k++)
+        distance += popcount64(a[k] ^ b[k]);
+
+    return distance;
+}
+
+#pragma mark - Distance kernels
+
+static void distancesScalar(const uchar* descriptor, const uchar* rows, size_t step, int count, int bytes, int* result)
+{
+    for (int j = 0; j < count; j++)
+        result[j] = hammingTail(descriptor, rows + j * step, 0, bytes);
+}
+
+#if defined(HAMMING_X86_KERNELS)
+
+// Same as the portable kernel, but compiled to the popcnt instruction
+__attribute__((target("popcnt")))
+static void distancesPopcnt(const uchar* descriptor, const uchar* rows, size_t step, int count, int bytes, int* result)
+{
+    for (int j = 0; j < count; j++)
+        result[j] = hammingTail(descriptor, rows + j * step, 0, bytes);
+}
+
+// Nibble lookup popcount (Mula et al.), summed per 64 bit lane with SAD
+__attribute__((target("avx2")))
+static inline __m256i popcountLanesAvx2(__m256i x)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+
+    const __m256i bits = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowNibbles)),
+                                         _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibbles)));
+
+    return _mm256_sad_epu8(bits, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx512vl,avx512vpopcntdq")))
+static inline __m256i popcountLanesAvx512(__m256i x)
+{
+    return _mm256_popcnt_epi64(x);
+}
+
+// Reduces the four 64 bit lanes of each of a, b, c and d into lanes 0 to 3
+__attribute__((target("avx2")))
+static inline __m256i laneSums(__m256i a, __m256i b, __m256i c, __m256i d)
+{
+    const __m256i ab = _mm256_add_epi64(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+    const __m256i cd = _mm256_add_epi64(_mm256_unpacklo_epi64(c, d), _mm256_unpackhi_epi64(c, d));
+    return _mm256_add_epi64(_mm256_permute2x128_si256(ab, cd, 0x20), _mm256_permute2x128_si256(ab, cd, 0x31));
+}
+
+// Stores the low 32 bits of the four 64 bit lanes
+__attribute__((target("avx2")))
+static inline void storeLaneSums(__m256i sums, int* result)
+{
+    const __m256i packed = _mm256_permutevar8x32_epi32(sums, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(result), _mm256_castsi256_si128(packed));
+}
+
+// Both 256 bit kernels compare the descriptor with four rows at a time, so that one reduction
+// serves four distances. They only differ in how the bits of a vector are counted.
+#define HAMMING_DISTANCES_256(popcountLanes)                                                                \
+    const int vectorBytes = bytes & ~31;                                                                   \
+    int j = 0;                                                                                             \
+                                                                                                           \
+    for (; j + 4 <= count; j += 4)                                                                         \
+    {                                                                                                      \
+        const uchar* r0 = rows + j * step;                                                                 \
+        const uchar* r1 = r0 + step;                                                                       \
+        const uchar* r2 = r1 + step;                                                                       \
+        const uchar* r3 = r2 + step;                                                                       \
+                                                                                                           \
+        __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;                                    \
+        for (int k = 0; k < vectorBytes; k += 32)                                                          \
+        {                                                                                                  \
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(descriptor + k));        \
+            s0 = _mm256_add_epi64(s0, popcountLanes(_mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + k))))); \
+            s1 = _mm256_add_epi64(s1, popcountLanes(_mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + k))))); \
+            s2 = _mm256_add_epi64(s2, popcountLanes(_mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + k))))); \
+            s3 = _mm256_add_epi64(s3, popcountLanes(_mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r3 + k))))); \
+        }                                                                                                  \
+        storeLaneSums(laneSums(s0, s1, s2, s3), result + j);                                               \
+                                                                                                           \
+        if (vectorBytes < bytes)                                                                           \
+        {                                                                                                  \
+            result[j]     += hammingTail(descriptor, r0, vectorBytes, bytes);                              \
+            result[j + 1] += hammingTail(descriptor, r1, vectorBytes, bytes);                              \
+            result[j + 2] += hammingTail(descriptor, r2, vectorBytes, bytes);                              \
+            result[j + 3] += hammingTail(descriptor, r3, vectorBytes, bytes);                              \
+        }                                                                                                  \
+    }                                                                                                      \
+                                                                                                           \
+    for (; j < count; j++)                                                                                 \
+        result[j] = hammingTail(descriptor, rows + j * step, 0, bytes);
+
+__attribute__((target("avx2,popcnt")))
+static void distancesAvx2(const uchar* descriptor, const uchar* rows, size_t step, int count, int bytes, int* result)
+{
+    HAMMING_DISTANCES_256(popcountLanesAvx2)
+}
+
+__attribute__((target("avx2,popcnt,avx512vl,avx512vpopcntdq")))
+static void distancesAvx512(const uchar* descriptor, const uchar* rows, size_t step, int count, int bytes, int* result)
+{
+    HAMMING_DISTANCES_256(popcountLanesAvx512)
+}
+
+#undef HAMMING_DISTANCES_256
+
+#endif
+
+struct SelectedKernel
+{
+    DistanceKernel kernel;
+    const char*    name;
+};
+
+static SelectedKernel selectKernel()
+{
+    SelectedKernel selected = { distancesScalar, "scalar" };
+
+#if defined(HAMMING_X86_KERNELS)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("avx512vl"))
+    {
+        selected.kernel = distancesAvx512;
+        selected.name   = "avx512";
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        selected.kernel = distancesAvx2;
+        selected.name   = "avx2";
+    }
+    else if (__builtin_cpu_supports("popcnt"))
+    {
+        selected.kernel = distancesPopcnt;
+        selected.name   = "popcnt";
+    }
+#endif
+
+    return selected;
+}
+
+static const SelectedKernel& kernel()
+{
+    static const SelectedKernel selected = selectKernel();
+    return selected;
+}
+
+// A block of train descriptors stays in L1 while all query descriptors stream past it
+static const int TrainBlock = 128;
+
+#pragma mark - HammingMatcher implementation
+
+void HammingMatcher::distances(const uchar* descriptor, const cv::Mat& train, int firstRow, int count, int* result)
+{
+    kernel().kernel(descriptor, train.ptr(firstRow), train.step, count, train.cols, result);
+}
+
+void HammingMatcher::nearestRows(const cv::Mat& rows, const cv::Mat& candidates, int* nearest, int* distance)
+{
+    CV_Assert(rows.type() == CV_8U && candidates.type() == CV_8U && rows.cols == candidates.cols);
+
+    std::fill(nearest, nearest + rows.rows, -1);
+    std::fill(distance, distance + rows.rows, INT_MAX);
+
+    int blockDistances[TrainBlock];
+
+    const DistanceKernel distanceKernel = kernel().kernel;
+
+    for (int firstRow = 0; firstRow < rows.rows; firstRow += TrainBlock)
+    {
+        const int count = std::min(TrainBlock, rows.rows - firstRow);
+        int* blockNearest  = nearest + firstRow;
+        int* blockDistance = distance + firstRow;
+
+        for (int i = 0; i < candidates.rows; i++)
+        {
+            distanceKernel(candidates.ptr(i), rows.ptr(firstRow), rows.step, count, rows.cols, blockDistances);
+
+            for (int j = 0; j < count; j++)
+            {
+                if (blockDistances[j] < blockDistance[j])
+                {
+                    blockDistance[j] = blockDistances[j];
+                    blockNearest[j]  = i;
+                }
+            }
+        }
+    }
+}
+
+void HammingMatcher::crossCheckMatch(const cv::Mat& query, const cv::Mat& train, std::vector<cv::DMatch>& matches)
+{
+    matches.clear();
+
+    if (query.empty() || train.empty())
+        return;
+
+    CV_Assert(query.type() == CV_8U && train.type() == CV_8U && query.cols == train.cols);
+
+    std::vector<int> nearestQuery(train.rows);
+    std::vector<int> nearestQueryDistance(train.rows);
+    nearestRows(train, query, &nearestQuery[0], &nearestQueryDistance[0]);
+
+    // Every query descriptor keeps the nearest train descriptor among those that picked it
+    std::vector<int> matchedTrain(query.rows, -1);
+    std::vector<int> matchedDistance(query.rows, INT_MAX);
+
+    for (int j = 0; j < train.rows; j++)
+    {
+        const int i = nearestQuery[j];
+        if (nearestQueryDistance[j] < matchedDistance[i])
+        {
+            matchedDistance[i] = nearestQueryDistance[j];
+            matchedTrain[i]    = j;
+        }
+    }
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        if (matchedTrain[i] >= 0)
+            matches.push_back(cv::DMatch(i, matchedTrain[i], static_cast<float>(matchedDistance[i])));
+    }
+}
+
+void HammingMatcher::nearestTwoRows(const cv::Mat& rows, const cv::Mat& candidates, int* nearest, int* distance, int* secondDistance)
+{
+    CV_Assert(rows.type() == CV_8U && candidates.type() == CV_8U && rows.cols == candidates.cols);
+
+    std::fill(nearest, nearest + rows.rows, -1);
+    std::fill(distance, distance + rows.rows, INT_MAX);
+    std::fill(secondDistance, secondDistance + rows.rows, INT_MAX);
+
+    int blockDistances[TrainBlock];
+
+    const DistanceKernel distanceKernel = kernel().kernel;
+
+    for (int firstCandidate = 0; firstCandidate < candidates.rows; firstCandidate += TrainBlock)
+    {
+        const int count = std::min(TrainBlock, candidates.rows - firstCandidate);
+
+        for (int i = 0; i < rows.rows; i++)
+        {
+            distanceKernel(rows.ptr(i), candidates.ptr(firstCandidate), candidates.step, count, candidates.cols, blockDistances);
+
+            int best = distance[i], second = secondDistance[i], bestCandidate = nearest[i];
+
+            // Same order of insertion as the k nearest neighbours of cv::BFMatcher, so ties resolve alike
+            for (int j = 0; j < count; j++)
+            {
+                const int d = blockDistances[j];
+                if (d < best)
+                {
+                    second        = best;
+                    best          = d;
+                    bestCandidate = firstCandidate + j;
+                }
+                else if (d < second)
+                {
+                    second = d;
+                }
+            }
+
+            distance[i]       = best;
+            secondDistance[i] = second;
+            nearest[i]        = bestCandidate;
+        }
+    }
+}
+
+void HammingMatcher::ratioTest(int i, int nearest, int distance, int secondDistance, float maxRatio, std::vector<cv::DMatch>& matches)
+{
+    // Without a second neighbour there is nothing to compare to, as with knnMatch on a single train row
+    if (secondDistance == INT_MAX)
+        return;
+
+    if (static_cast<float>(distance) < maxRatio * static_cast<float>(secondDistance))
+        matches.push_back(cv::DMatch(i, nearest, static_cast<float>(distance)));
+}
+
+void HammingMatcher::ratioMatch(const cv::Mat& query, const cv::Mat& train, float maxRatio, std::vector<cv::DMatch>& matches)
+{
+    matches.clear();
+
+    if (query.empty() || train.empty())
+        return;
+
+    CV_Assert(query.type() == CV_8U && train.type() == CV_8U && query.cols == train.cols);
+
+    std::vector<int> nearestTrain(query.rows), nearestDistance(query.rows), secondDistance(query.rows);
+    nearestTwoRows(query, train, &nearestTrain[0], &nearestDistance[0], &secondDistance[0]);
+
+    for (int i = 0; i < query.rows; i++)
+        ratioTest(i, nearestTrain[i], nearestDistance[i], secondDistance[i], maxRatio, matches);
+}
+
+const char* HammingMatcher::kernelName()
+{
+    return kernel().name;
+}
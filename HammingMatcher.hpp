@@ -0,0 +1,42 @@
+#ifndef HammingMatcher_hpp
+#define HammingMatcher_hpp
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+//! Exact brute force matcher for binary descriptors (CV_8U rows compared by Hamming distance).
+//! Distances are computed with AVX-512 or AVX2 popcount when the CPU supports it and with a
+//! portable kernel otherwise.
+class HammingMatcher
+{
+public:
+    //! Cross-checked matches of query against train, identical to those of
+    //! cv::BFMatcher(NORM_HAMMING, true): every train descriptor picks its nearest query descriptor,
+    //! and every query descriptor keeps the nearest of the train descriptors that picked it. Ties go
+    //! to the lower index. Every distance is computed once, tile by tile.
+    static void crossCheckMatch(const cv::Mat& query, const cv::Mat& train, std::vector<cv::DMatch>& matches);
+
+    //! Nearest train descriptor of every query descriptor that passes the ratio test, identical to
+    //! cv::BFMatcher(NORM_HAMMING).knnMatch with k = 2 followed by the ratio test. The two nearest distances
+    //! are tracked while the distances are computed, so the k nearest neighbours are never stored.
+    static void ratioMatch(const cv::Mat& query, const cv::Mat& train, float maxRatio, std::vector<cv::DMatch>& matches);
+
+    //! For every row of rows, the nearest row of candidates and its distance; ties go to the lower index.
+    //! nearest and distance must hold rows.rows elements.
+    static void nearestRows(const cv::Mat& rows, const cv::Mat& candidates, int* nearest, int* distance);
+
+    //! Same as nearestRows, also with the distance of the second nearest row of candidates, INT_MAX if there
+    //! is none. secondDistance must hold rows.rows elements as well.
+    static void nearestTwoRows(const cv::Mat& rows, const cv::Mat& candidates, int* nearest, int* distance, int* secondDistance);
+
+    //! Appends the match of row i to its nearest candidate if it passes the ratio test, as ratioMatch does.
+    static void ratioTest(int i, int nearest, int distance, int secondDistance, float maxRatio, std::vector<cv::DMatch>& matches);
+
+    //! Distances from one descriptor to count consecutive descriptors of train starting at firstRow.
+    static void distances(const uchar* descriptor, const cv::Mat& train, int firstRow, int count, int* result);
+
+    //! Name of the distance kernel selected for this CPU.
+    static const char* kernelName();
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "ImagePipeline.hpp"
+#include "StageProfiler.hpp"
+
+#include <iostream>
+
+namespace fs = boost::filesystem;
+
+ImagePipeline::ImagePipeline(const fs::path& srcDir, size_t queueDepth, const FeatureCache& featureCache,
+                             const std::set<std::string>& skipImages)
+: m_srcDir(srcDir)
+, m_featureCache(featureCache)
+, m_skipImages(skipImages)
+, m_listed(queueDepth)
+, m_decoded(queueDepth)
+, m_detected(queueDepth)
+{
+    if (fs::is_regular_file(srcDir) && m_dataset.open(srcDir.string()))
+    {
+        m_threads.push_back(std::thread(&ImagePipeline::listPackedImages, this));
+    }
+    else
+    {
+        m_threads.push_back(std::thread(&ImagePipeline::listImages, this));
+        m_threads.push_back(std::thread(&ImagePipeline::decodeImages, this));
+    }
+    m_threads.push_back(std::thread(&ImagePipeline::detectKeypoints, this));
+}
+
+ImagePipeline::~ImagePipeline()
+{
+    // Unblock stages that are still waiting if the consumer stopped early
+    m_listed.close();
+    m_decoded.close();
+    m_detected.close();
+
+    for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+}
+
+bool ImagePipeline::next(SourceFrame& frame)
+{
+    return m_detected.pop(frame);
+}
+
+void ImagePipeline::listImages()
+{
+    fs::directory_iterator it(m_srcDir), eod;
+
+    for (; it != eod; ++it)
+    {
+        const fs::path& path = it->path();
+        std::string name = path.filename().string();
+
+        if (fs::is_regular_file(path) && name[0] != '.' && m_skipImages.count(name) == 0)
+        {
+            if (!m_listed.push(path))
+                break;
+        }
+    }
+
+    m_listed.close();
+}
+
+void ImagePipeline::decodeImages()
+{
+    fs::path path;
+
+    while (m_listed.pop(path))
+    {
+        SourceFrame frame;
+        frame.path = path;
+        frame.name = path.filename().string();
+        frame.hash = 0;
+
+        try
+        {
+            ScopedStageTimer timer(StageDecode);
+            frame.image = PackedDataset::decodeGrayscale(path.string());
+        }
+        catch (const std::exception& e)
+        {
+            // Handed on without an image, so that the consumer skips it and the stages keep running
+            std::cout << "Cannot decode " << path.string() << ": " << e.what() << std::endl;
+            frame.image.release();
+        }
+
+        if (!m_decoded.push(std::move(frame)))
+            break;
+    }
+
+    m_decoded.close();
+}
+
+void ImagePipeline::listPackedImages()
+{
+    for (size_t i = 0; i < m_dataset.size(); i++)
+    {
+        const std::string& name = m_dataset.name(i);
+        if (m_skipImages.count(name))
+            continue;
+
+        SourceFrame frame;
+        frame.path = m_srcDir / name;
+        frame.name = name;
+        frame.hash = 0;
+
+        {
+            ScopedStageTimer timer(StageDecode);
+            frame.image = m_dataset.image(i);
+        }
+
+        if (!m_decoded.push(std::move(frame)))
+            break;
+    }
+
+    m_decoded.close();
+}
+
+void ImagePipeline::detectKeypoints()
+{
+    SourceFrame frame;
+
+    while (m_decoded.pop(frame))
+    {
+        if (!frame.image.empty())
+        {
+            try
+            {
+                frame.hash     = FeatureCache::hashImage(frame.image);
+                frame.cacheKey = FeatureCache::frameKey(frame.hash, std::string(), 0) + "|SURF";
+
+                CachedFeatures cached;
+                if (m_featureCache.load(frame.cacheKey, "keypoints", cached))
+                {
+                    frame.keypoints = cached.keypoints;
+                }
+                else
+                {
+                    ScopedStageTimer timer(StageDetect);
+                    FeatureAlgorithm::detector().detect(frame.image, frame.keypoints);
+
+                    cached.keypoints = frame.keypoints;
+                    m_featureCache.store(frame.cacheKey, "keypoints", cached);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                // Without keypoints the image cannot be evaluated; it is handed on empty so that the consumer skips it
+                std::cout << "Cannot detect keypoints on " << frame.name << ": " << e.what() << std::endl;
+                frame.image.release();
+                frame.keypoints.clear();
+            }
+        }
+
+        if (!m_detected.push(std::move(frame)))
+            break;
+    }
+
+    m_detected.close();
+}
@@ -0,0 +1,66 @@
+#ifndef ImagePipeline_hpp
+#define ImagePipeline_hpp
+
+#include "FeatureCache.hpp"
+#include "BoundedQueue.hpp"
+#include "PackedDataset.hpp"
+
+#include <boost/filesystem.hpp>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Grayscale source image together with the keypoints detected on it.
+struct SourceFrame
+{
+    boost::filesystem::path path;
+    std::string             name;
+
+    //! Empty if the file could not be decoded or keypoint detection failed on it. An image without any
+    //! keypoints is still handed on, with keypoints empty.
+    cv::Mat                 image;
+    Keypoints               keypoints;
+
+    //! Content hash of image and the key of the source frame in the feature cache.
+    uint64                  hash;
+    std::string             cacheKey;
+};
+
+//! Lists, decodes and runs source keypoint detection on background threads, one thread per stage,
+//! so that the next images are ready while the current one is being evaluated.
+class ImagePipeline
+{
+public:
+    //! Starts the pipeline over all visible regular files of srcDir, or over the images of srcDir if it is
+    //! a packed dataset, which need no decoding. queueDepth bounds the number of images buffered between every two stages. Source keypoints are looked up in and added to featureCache.
+    //! Files named in skipImages are not handed out.
+    ImagePipeline(const boost::filesystem::path& srcDir, size_t queueDepth, const FeatureCache& featureCache,
+                  const std::set<std::string>& skipImages = std::set<std::string>());
+    ~ImagePipeline();
+
+    //! Blocks until the next image is available. Returns false when all images have been handed out.
+    bool next(SourceFrame& frame);
+
+private:
+    ImagePipeline(const ImagePipeline&);
+    ImagePipeline& operator=(const ImagePipeline&);
+
+    void listImages();
+    void decodeImages();
+    void listPackedImages();
+    void detectKeypoints();
+
+    boost::filesystem::path                  m_srcDir;
+    const FeatureCache&                      m_featureCache;
+    std::set<std::string>                    m_skipImages;
+    PackedDataset                            m_dataset;
+
+    BoundedQueue<boost::filesystem::path>    m_listed;
+    BoundedQueue<SourceFrame>                m_decoded;
+    BoundedQueue<SourceFrame>                m_detected;
+
+    std::vector<std::thread>                 m_threads;
+};
+
+#endif
@@ -1,18 +1,97 @@
 #include "ImageTransformation.hpp"
+#include "RemapCache.hpp"
+#include <iomanip>
+#include <sstream>
+
+void ImageTransformation::transformSweep(const cv::Mat& source, std::vector<cv::Mat>& results) const
+{
+    const std::vector<float> x = getX();
+    results.resize(x.size());
+
+    for (size_t i = 0; i < x.size(); i++)
+        transform(x[i], source, results[i]);
+}
+
+bool ImageTransformation::incrementalSweep() const
+{
+    return false;
+}
+
+std::string ImageTransformation::fingerprint() const
+{
+    std::ostringstream str;
+    str << std::setprecision(9) << name << "(";
+    writeParameters(str);
+    str << ")";
+
+    // Frames of a sweep are derived from each other and may differ slightly from transforming the source
+    if (incrementalSweep())
+        str << "/sweep";
+
+    return str.str();
+}
+
+void ImageTransformation::writeParameters(std::ostream& str) const
+{
+}
 
 bool ImageTransformation::multiplyHomography() const
 {
     return false;
 }
 
-void ImageTransformation::transform(float t, const Keypoints& source, Keypoints& result) const
+bool ImageTransformation::isGeometric() const
 {
+    return false;
+}
+
+void ImageTransformation::transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const
+{
+    projectKeypoints(homography(t, sourceSize), source, result);
+}
 
+cv::Size ImageTransformation::getOutputSize(float t, const cv::Size& sourceSize) const
+{
+    return sourceSize;
 }
 
-cv::Mat ImageTransformation::getHomography(float t, const cv::Mat& source) const
+cv::Matx33d ImageTransformation::getHomography(float t, const cv::Size& sourceSize) const
 {
-    return cv::Mat::eye(3, 3, CV_64FC1);
+    return cv::Matx33d::eye();
+}
+
+const ImageTransformation::HomographyTable& ImageTransformation::homographyTable(const cv::Size& sourceSize) const
+{
+    std::lock_guard<std::mutex> guard(m_homographyTablesLock);
+
+    // Entries of a std::map stay where they are, so the table can be used after the lock is released
+    HomographyTable& table = m_homographyTables[std::make_pair(sourceSize.width, sourceSize.height)];
+    if (table.x.empty())
+    {
+        table.x = getX();
+        table.homographies.resize(table.x.size());
+
+        for (size_t i = 0; i < table.x.size(); i++)
+            table.homographies[i] = getHomography(table.x[i], sourceSize);
+    }
+    return table;
+}
+
+const std::vector<cv::Matx33d>& ImageTransformation::homographies(const cv::Size& sourceSize) const
+{
+    return homographyTable(sourceSize).homographies;
+}
+
+cv::Matx33d ImageTransformation::homography(float t, const cv::Size& sourceSize) const
+{
+    const HomographyTable& table = homographyTable(sourceSize);
+
+    for (size_t i = 0; i < table.x.size(); i++)
+    {
+        if (table.x[i] == t)
+            return table.homographies[i];
+    }
+    return getHomography(t, sourceSize);
 }
 
 
@@ -111,6 +190,47 @@ bool ImageTransformation::findHomography( const Keypoints& source, const Keypoin
     */
 }
 
+void ImageTransformation::projectKeypoints(const cv::Matx33d& H, const Keypoints& source, Keypoints& result)
+{
+    const double h00 = H(0, 0), h01 = H(0, 1), h02 = H(0, 2);
+    const double h10 = H(1, 0), h11 = H(1, 1), h12 = H(1, 2);
+    const double h20 = H(2, 0), h21 = H(2, 1), h22 = H(2, 2);
+
+    result.resize(source.size());
+
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        const cv::KeyPoint& kp = source[i];
+        cv::KeyPoint& res = result[i];
+        res = kp;
+
+        const double x = kp.pt.x, y = kp.pt.y;
+        const double w = h20 * x + h21 * y + h22;
+        const double u = (h00 * x + h01 * y + h02) / w;
+        const double v = (h10 * x + h11 * y + h12) / w;
+
+        // Jacobian of the projective mapping at (x, y)
+        const double j00 = (h00 - u * h20) / w, j01 = (h01 - u * h21) / w;
+        const double j10 = (h10 - v * h20) / w, j11 = (h11 - v * h21) / w;
+
+        res.pt   = cv::Point2f(static_cast<float>(u), static_cast<float>(v));
+        res.size = static_cast<float>(kp.size * std::sqrt(std::abs(j00 * j11 - j01 * j10)));
+
+        if (kp.angle >= 0)
+        {
+            const double a  = kp.angle * CV_PI / 180.;
+            const double dx = j00 * std::cos(a) + j01 * std::sin(a);
+            const double dy = j10 * std::cos(a) + j11 * std::sin(a);
+
+            double angle = std::atan2(dy, dx) * 180. / CV_PI;
+            if (angle < 0)
+                angle += 360.;
+
+            res.angle = static_cast<float>(angle);
+        }
+    }
+}
+
 #pragma mark - ImageRotationTransformation implementation
 
 ImageRotationTransformation::ImageRotationTransformation(float startAngleInDeg, float endAngleInDeg, float step, cv::Point2f rotationCenterInUnitSpace)
@@ -132,9 +252,31 @@ std::vector<float> ImageRotationTransformation::getX() const
 
 void ImageRotationTransformation::transform(float t, const cv::Mat& source, cv::Mat& result) const
 {
-    cv::Point2f center(source.cols * m_rotationCenterInUnitSpace.x, source.rows * m_rotationCenterInUnitSpace.y);
-    cv::Mat rotationMat = cv::getRotationMatrix2D(center, t, 1);
-    cv::warpAffine(source, result, rotationMat, source.size(), cv::INTER_CUBIC);
+    RemapCache::instance().warp(this, t, source, result, homography(t, source.size()), source.size(), cv::INTER_CUBIC);
+}
+
+void ImageRotationTransformation::transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const
+{
+    const cv::Matx33d rotationMat = homography(t, sourceSize);
+
+    result.resize(source.size());
+
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        const cv::KeyPoint& kp = source[i];
+        cv::KeyPoint& res = result[i];
+        res = kp;
+
+        res.pt.x = static_cast<float>(rotationMat(0, 0) * kp.pt.x + rotationMat(0, 1) * kp.pt.y + rotationMat(0, 2));
+        res.pt.y = static_cast<float>(rotationMat(1, 0) * kp.pt.x + rotationMat(1, 1) * kp.pt.y + rotationMat(1, 2));
+
+        // A counter-clockwise rotation of the image decreases angles measured in image coordinates
+        if (kp.angle >= 0)
+        {
+            float angle = std::fmod(kp.angle - t, 360.f);
+            res.angle = angle < 0 ? angle + 360.f : angle;
+        }
+    }
 }
 
 // void ImageRotationTransformation::transform(float t, const cv::Mat& source, cv::Mat& result) const {
@@ -145,14 +287,27 @@ void ImageRotationTransformation::transform(float t, const cv::Mat& source, cv::
 //     rot.at<double>(1, 2) += bbox.height / 2.0 - center.y;
 //     cv::warpAffine(source, result, rot, bbox.size());
 // }
-cv::Mat ImageRotationTransformation::getHomography(float t, const cv::Mat& source) const
+cv::Matx33d ImageRotationTransformation::getHomography(float t, const cv::Size& sourceSize) const
 {
-    cv::Point2f center(source.cols * m_rotationCenterInUnitSpace.x, source.rows * m_rotationCenterInUnitSpace.y);
-    cv::Mat rotationMat = cv::getRotationMatrix2D(center, t, 1);
+    // Same as cv::getRotationMatrix2D(center, t, 1)
+    const double cx = sourceSize.width * m_rotationCenterInUnitSpace.x;
+    const double cy = sourceSize.height * m_rotationCenterInUnitSpace.y;
+    const double a  = std::cos(t * CV_PI / 180.);
+    const double b  = std::sin(t * CV_PI / 180.);
 
-    cv::Mat h = cv::Mat::eye(3, 3, CV_64FC1);
-    rotationMat.copyTo(h(cv::Range(0, 2), cv::Range(0, 3)));
-    return h;
+    return cv::Matx33d( a, b, (1 - a) * cx - b * cy,
+                       -b, a, b * cx + (1 - a) * cy,
+                        0, 0, 1);
+}
+
+bool ImageRotationTransformation::isGeometric() const
+{
+    return true;
+}
+
+void ImageRotationTransformation::writeParameters(std::ostream& str) const
+{
+    str << m_startAngleInDeg << "," << m_endAngleInDeg << "," << m_step << "," << m_rotationCenterInUnitSpace.x << "," << m_rotationCenterInUnitSpace.y;
 }
 // cv::Mat ImageRotationTransformation::getHomography(float t, const cv::Mat& source) const
 // {
@@ -235,37 +390,22 @@ std::vector<float> ImageYRotationTransformation::getX() const
 }
 
 void ImageYRotationTransformation::transform(float t, const cv::Mat& source, cv::Mat& result) const {
-    cv::warpPerspective(source, result, getHomography(t, source), source.size(), cv::INTER_LANCZOS4);
+    RemapCache::instance().warp(this, t, source, result, homography(t, source.size()), source.size(), cv::INTER_LANCZOS4);
 }
 
-cv::Mat ImageYRotationTransformation::getHomography(float t, const cv::Mat& source) const
+cv::Matx33d ImageYRotationTransformation::getHomography(float t, const cv::Size& sourceSize) const
 {
-    double beta = ((90 - t) - 90.) * CV_PI / 180.;
-    double w = (double)source.cols;
-    double h = (double)source.rows;
-    cv::Mat A1 = (cv::Mat_<double>(4, 3) <<
-                  1, 0, -w / 2,
-                  0, 1, -h / 2,
-                  0, 0,    0,
-                  0, 0,    1);
-    cv::Mat RY = (cv::Mat_<double>(4, 4) <<
-                  cos(beta), 0, -sin(beta), 0,
-                  0, 1,          0, 0,
-                  sin(beta), 0,  cos(beta), 0,
-                  0, 0,          0, 1);
-    cv::Mat T = (cv::Mat_<double>(4, 4) <<
-                 1, 0, 0, 0,
-                 0, 1, 0, 0,
-                 0, 0, 1, source.cols,
-                 0, 0, 0, 1);
-    // 3D -> 2D matrix
-    cv::Mat A2 = (cv::Mat_<double>(3, 4) <<
-                  source.cols, 0, w / 2, 0,
-                  0, source.cols, h / 2, 0,
-                  0, 0,   1, 0);
-    // Final transformation matrix
-    cv::Mat trans = A2 * (T * (RY * A1));
-    return trans;
+    // Closed form of A2 * T * RY * A1: the image plane, centred at the origin, is rotated by -t degrees
+    // about the y axis, moved w away from a camera with focal length w and projected back
+    const double beta = -t * CV_PI / 180.;
+    const double c = std::cos(beta), s = std::sin(beta);
+    const double w = sourceSize.width;
+    const double h = sourceSize.height;
+    const double z = w - s * w / 2;
+
+    return cv::Matx33d(w * c + w / 2 * s, 0, -w * c * w / 2 + w / 2 * z,
+                       h / 2 * s,         w, -w * h / 2 + h / 2 * z,
+                       s,                 0, z);
 }
 
 bool ImageYRotationTransformation::multiplyHomography() const
@@ -273,6 +413,16 @@ bool ImageYRotationTransformation::multiplyHomography() const
     return true;
 }
 
+bool ImageYRotationTransformation::isGeometric() const
+{
+    return true;
+}
+
+void ImageYRotationTransformation::writeParameters(std::ostream& str) const
+{
+    str << m_startAngleInDeg << "," << m_endAngleInDeg << "," << m_step << "," << m_rotationCenterInUnitSpace.x << "," << m_rotationCenterInUnitSpace.y;
+}
+
 #pragma mark - ImageXRotationTransformation implementation
 
 ImageXRotationTransformation::ImageXRotationTransformation(float startAngleInDeg, float endAngleInDeg, float step, cv::Point2f rotationCenterInUnitSpace)
@@ -293,37 +443,21 @@ std::vector<float> ImageXRotationTransformation::getX() const
 }
 
 void ImageXRotationTransformation::transform(float t, const cv::Mat& source, cv::Mat& result) const {
-    cv::warpPerspective(source, result, getHomography(t, source), source.size(), cv::INTER_LANCZOS4);
+    RemapCache::instance().warp(this, t, source, result, homography(t, source.size()), source.size(), cv::INTER_LANCZOS4);
 }
 
-cv::Mat ImageXRotationTransformation::getHomography(float t, const cv::Mat& source) const
+cv::Matx33d ImageXRotationTransformation::getHomography(float t, const cv::Size& sourceSize) const
 {
-    double alpha = ((90 - t) - 90.) * CV_PI / 180.;
-    double w = (double)source.cols;
-    double h = (double)source.rows;
-    cv::Mat A1 = (cv::Mat_<double>(4, 3) <<
-                  1, 0, -w / 2,
-                  0, 1, -h / 2,
-                  0, 0,    0,
-                  0, 0,    1);
-    cv::Mat RX = (cv::Mat_<double>(4, 4) <<
-                  1,          0,           0, 0,
-                  0, cos(alpha), -sin(alpha), 0,
-                  0, sin(alpha),  cos(alpha), 0,
-                  0,          0,           0, 1);
-    cv::Mat T = (cv::Mat_<double>(4, 4) <<
-                 1, 0, 0, 0,
-                 0, 1, 0, 0,
-                 0, 0, 1, source.rows,
-                 0, 0, 0, 1);
-    // 3D -> 2D matrix
-    cv::Mat A2 = (cv::Mat_<double>(3, 4) <<
-                  source.rows, 0, w / 2, 0,
-                  0, source.rows, h / 2, 0,
-                  0, 0,   1, 0);
-    // Final transformation matrix
-    cv::Mat trans = A2 * (T * (RX * A1));
-    return trans;
+    // Closed form of A2 * T * RX * A1, like the y rotation with the axes swapped and focal length h
+    const double alpha = -t * CV_PI / 180.;
+    const double c = std::cos(alpha), s = std::sin(alpha);
+    const double w = sourceSize.width;
+    const double h = sourceSize.height;
+    const double z = h - s * h / 2;
+
+    return cv::Matx33d(h, w / 2 * s,         -h * w / 2 + w / 2 * z,
+                       0, h * c + h / 2 * s, -h * c * h / 2 + h / 2 * z,
+                       0, s,                 z);
 }
 
 bool ImageXRotationTransformation::multiplyHomography() const
@@ -331,6 +465,16 @@ bool ImageXRotationTransformation::multiplyHomography() const
     return true;
 }
 
+bool ImageXRotationTransformation::isGeometric() const
+{
+    return true;
+}
+
+void ImageXRotationTransformation::writeParameters(std::ostream& str) const
+{
+    str << m_startAngleInDeg << "," << m_endAngleInDeg << "," << m_step << "," << m_rotationCenterInUnitSpace.x << "," << m_rotationCenterInUnitSpace.y;
+}
+
 #pragma mark - ImageScalingTransformation implementation
 
 ImageScalingTransformation::ImageScalingTransformation(float minScale, float maxScale, float step)
@@ -352,15 +496,41 @@ std::vector<float> ImageScalingTransformation::getX() const
 
 void ImageScalingTransformation::transform(float t, const cv::Mat& source, cv::Mat& result)const
 {
-    cv::Size dstSize(static_cast<int>(source.cols * t + 0.5f), static_cast<int>(source.rows * t + 0.5f));
-    cv::resize(source, result, dstSize, cv::INTER_AREA);
+    cv::resize(source, result, getOutputSize(t, source.size()), cv::INTER_AREA);
 }
 
-cv::Mat ImageScalingTransformation::getHomography(float t, const cv::Mat& source) const
+void ImageScalingTransformation::transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const
 {
-    cv::Mat h = cv::Mat::eye(3, 3, CV_64FC1);
-    h.at<double>(0, 0) = h.at<double>(1, 1) = t;
-    return h;
+    result.resize(source.size());
+
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        result[i] = source[i];
+        result[i].pt   = source[i].pt * t;
+        result[i].size = source[i].size * t;
+    }
+}
+
+cv::Size ImageScalingTransformation::getOutputSize(float t, const cv::Size& sourceSize) const
+{
+    return cv::Size(static_cast<int>(sourceSize.width * t + 0.5f), static_cast<int>(sourceSize.height * t + 0.5f));
+}
+
+cv::Matx33d ImageScalingTransformation::getHomography(float t, const cv::Size& sourceSize) const
+{
+    return cv::Matx33d(t, 0, 0,
+                       0, t, 0,
+                       0, 0, 1);
+}
+
+bool ImageScalingTransformation::isGeometric() const
+{
+    return true;
+}
+
+void ImageScalingTransformation::writeParameters(std::ostream& str) const
+{
+    str << m_minScale << "," << m_maxScale << "," << m_step;
 }
 
 #pragma mark - GaussianBlurTransform implementation
@@ -384,6 +554,70 @@ void GaussianBlurTransform::transform(float t, const cv::Mat& source, cv::Mat& r
     cv::GaussianBlur(source, result, cv::Size(kernelSize, kernelSize), 0);
 }
 
+// Variance of the kernel cv::GaussianBlur uses for the given size when sigma is derived from it
+static double gaussianKernelVariance(int kernelSize)
+{
+    const cv::Mat_<double> kernel = cv::getGaussianKernel(kernelSize, 0, CV_64F);
+
+    double variance = 0;
+    for (int i = 0; i < kernelSize; i++)
+    {
+        const double x = i - kernelSize / 2;
+        variance += kernel(i) * x * x;
+    }
+    return variance;
+}
+
+void GaussianBlurTransform::transformSweep(const cv::Mat& source, std::vector<cv::Mat>& results) const
+{
+    results.resize(m_args.size());
+
+    // Composing kernels smaller than this drifts by up to 4 grey levels from the direct blur
+    const int directKernelSize = 7;
+
+    // The current level is kept in floating point so that rounding does not accumulate along the sweep
+    const int levelType = CV_MAKETYPE(CV_32F, source.channels());
+    cv::Mat   level;
+    double    levelVariance = 0;
+
+    for (size_t i = 0; i < m_args.size(); i++)
+    {
+        const int    kernelSize = static_cast<int>(m_args[i]) * 2 + 1;
+        const double variance   = gaussianKernelVariance(kernelSize);
+
+        if (level.empty() || variance <= levelVariance || kernelSize <= directKernelSize)
+        {
+            transform(m_args[i], source, results[i]);
+
+            cv::Mat floatSource;
+            source.convertTo(floatSource, levelType);
+            cv::GaussianBlur(floatSource, level, cv::Size(kernelSize, kernelSize), 0);
+        }
+        else
+        {
+            cv::GaussianBlur(level, level, cv::Size(), std::sqrt(variance - levelVariance));
+            level.convertTo(results[i], source.type());
+        }
+
+        levelVariance = variance;
+    }
+}
+
+bool GaussianBlurTransform::incrementalSweep() const
+{
+    return true;
+}
+
+void GaussianBlurTransform::writeParameters(std::ostream& str) const
+{
+    str << m_maxKernelSize;
+}
+
+void GaussianBlurTransform::transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const
+{
+    result = source;
+}
+
 #pragma mark - BrightnessImageTransform implementation
 
 BrightnessImageTransform::BrightnessImageTransform(int min, int max, int step)
@@ -393,7 +627,15 @@ BrightnessImageTransform::BrightnessImageTransform(int min, int max, int step)
     , m_step(step)
 {
     for (int arg = min; arg <= max; arg += step)
+    {
         m_args.push_back(static_cast<float>(arg));
+
+        cv::Mat_<uchar> table(1, 256);
+        for (int value = 0; value < 256; value++)
+            table(value) = cv::saturate_cast<uchar>(value + arg);
+
+        m_lookupTables.push_back(table);
+    }
 }
 
 std::vector<float> BrightnessImageTransform::getX() const
@@ -406,12 +648,42 @@ void BrightnessImageTransform::transform(float t, const cv::Mat& source, cv::Mat
     result = source + cv::Scalar(t, t, t, t);
 }
 
+void BrightnessImageTransform::transformSweep(const cv::Mat& source, std::vector<cv::Mat>& results) const
+{
+    if (source.depth() != CV_8U)
+    {
+        ImageTransformation::transformSweep(source, results);
+        return;
+    }
+
+    results.resize(m_args.size());
+
+    for (size_t i = 0; i < m_args.size(); i++)
+        cv::LUT(source, m_lookupTables[i], results[i]);
+}
+
+bool BrightnessImageTransform::incrementalSweep() const
+{
+    return true;
+}
+
+void BrightnessImageTransform::writeParameters(std::ostream& str) const
+{
+    str << m_min << "," << m_max << "," << m_step;
+}
+
+void BrightnessImageTransform::transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const
+{
+    result = source;
+}
+
 #pragma mark - CombinedTransform implementation
 
 CombinedTransform::CombinedTransform(cv::Ptr<ImageTransformation> first, cv::Ptr<ImageTransformation> second, ParamCombinationType type)
     : ImageTransformation(first->name + "+" + second->name)
     , m_first(first)
     , m_second(second)
+    , m_type(type)
 {
     std::vector<float> x1 = first->getX();
     std::vector<float> x2 = second->getX();
@@ -505,34 +777,74 @@ void CombinedTransform::transform(float t, const cv::Mat& source, cv::Mat& resul
     float t1 = m_params[index].first;
     float t2 = m_params[index].second;
 
-    if (!multiplyHomography()) {
+    const cv::Matx33d h = homography(t, source.size());
+
+    if (multiplyHomography()) {
+        RemapCache::instance().warp(this, t, source, result, h, source.size(), cv::INTER_LANCZOS4);
+    } else if (isGeometric() && !shrinks(h)) {
+        // Both steps are warps, so the composed homography takes the source to the result in a single interpolation pass
+        const bool affine = h(2, 0) == 0 && h(2, 1) == 0 && h(2, 2) == 1;
+
+        RemapCache::instance().warp(this, t, source, result, h, getOutputSize(t, source.size()),
+                                    affine ? cv::INTER_CUBIC : cv::INTER_LANCZOS4);
+    } else {
+        // Down-scales keep their own steps, so that the scaling filters the source with INTER_AREA
+        // instead of the single warp aliasing it
         cv::Mat temp;
         m_first->transform(t1, source, temp);
         m_second->transform(t2, temp, result);
-    } else {
-        cv::Mat first_homography = m_first->getHomography(t1, source);
-        cv::Mat second_homography = m_second->getHomography(t2, source);
-        cv::Mat combo = first_homography * second_homography;
-        cv::warpPerspective(source, result, combo, source.size(), cv::INTER_LANCZOS4);
     }
 }
 
+bool CombinedTransform::shrinks(const cv::Matx33d& h)
+{
+    // Area scale of the linear part at the origin of the source
+    const double det = (h(0, 0) * h(1, 1) - h(0, 1) * h(1, 0)) / (h(2, 2) * h(2, 2));
+    return std::abs(det) < 1 - 1e-6;
+}
+
 bool CombinedTransform::multiplyHomography() const
 {
     return m_first->multiplyHomography() && m_second->multiplyHomography();
 }
 
-void CombinedTransform::transform(float t, const Keypoints& source, Keypoints& result) const
+bool CombinedTransform::isGeometric() const
 {
+    return m_first->isGeometric() && m_second->isGeometric();
+}
+
+void CombinedTransform::writeParameters(std::ostream& str) const
+{
+    str << m_first->fingerprint() << "," << m_second->fingerprint() << "," << m_type;
+}
+
+void CombinedTransform::transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const
+{
+    if (multiplyHomography()) {
+        ImageTransformation::transform(t, sourceSize, source, result);
+        return;
+    }
+
     size_t index = static_cast<size_t>(t);
     float t1 = m_params[index].first;
     float t2 = m_params[index].second;
     Keypoints temp;
-    m_first->transform(t1, source, temp);
-    m_second->transform(t2, temp, result);
+    m_first->transform(t1, sourceSize, source, temp);
+    m_second->transform(t2, m_first->getOutputSize(t1, sourceSize), temp, result);
 }
 
-cv::Mat CombinedTransform::getHomography(float t, const cv::Mat& source) const
+cv::Size CombinedTransform::getOutputSize(float t, const cv::Size& sourceSize) const
+{
+    if (multiplyHomography())
+        return sourceSize;
+
+    size_t index = static_cast<size_t>(t);
+    float t1 = m_params[index].first;
+    float t2 = m_params[index].second;
+    return m_second->getOutputSize(t2, m_first->getOutputSize(t1, sourceSize));
+}
+
+cv::Matx33d CombinedTransform::getHomography(float t, const cv::Size& sourceSize) const
 {
     size_t index = static_cast<size_t>(t);
 
@@ -540,13 +852,10 @@ cv::Mat CombinedTransform::getHomography(float t, const cv::Mat& source) const
     float t2 = m_params[index].second;
 
     if (!multiplyHomography()) {
-        cv::Mat temp;
-        m_first->transform(t1, source, temp);
-        return m_second->getHomography(t2, temp) * m_first->getHomography(t1, source);
+        cv::Size intermediateSize = m_first->getOutputSize(t1, sourceSize);
+        return m_second->homography(t2, intermediateSize) * m_first->homography(t1, sourceSize);
     }
-    cv::Mat first_homography = m_first->getHomography(t1, source);
-    cv::Mat second_homography = m_second->getHomography(t2, source);
-    return first_homography * second_homography;
+    return m_first->homography(t1, sourceSize) * m_second->homography(t2, sourceSize);
 }
 
 #pragma mark PerspectiveTransform implementation
@@ -563,22 +872,21 @@ PerspectiveTransform::PerspectiveTransform(int count)
     }
 }
 
-cv::Mat PerspectiveTransform::warpPerspectiveRand( cv::RNG& rng )
+cv::Matx33d PerspectiveTransform::warpPerspectiveRand( cv::RNG& rng )
 {
-    cv::Mat H;
+    cv::Matx33d H;
 
-    H.create(3, 3, CV_64FC1);
-    H.at<double>(0, 0) = rng.uniform( 0.8f, 1.2f);
-    H.at<double>(0, 1) = rng.uniform(-0.1f, 0.1f);
-    //H.at<double>(0,2) = rng.uniform(-0.1f, 0.1f)*src.cols;
-    H.at<double>(0, 2) = rng.uniform(-0.1f, 0.1f);
-    H.at<double>(1, 0) = rng.uniform(-0.1f, 0.1f);
-    H.at<double>(1, 1) = rng.uniform( 0.8f, 1.2f);
-    //H.at<double>(1,2) = rng.uniform(-0.1f, 0.1f)*src.rows;
-    H.at<double>(1, 2) = rng.uniform(-0.1f, 0.1f);
-    H.at<double>(2, 0) = rng.uniform( -1e-4f, 1e-4f);
-    H.at<double>(2, 1) = rng.uniform( -1e-4f, 1e-4f);
-    H.at<double>(2, 2) = rng.uniform( 0.8f, 1.2f);
+    H(0, 0) = rng.uniform( 0.8f, 1.2f);
+    H(0, 1) = rng.uniform(-0.1f, 0.1f);
+    //H(0,2) = rng.uniform(-0.1f, 0.1f)*src.cols;
+    H(0, 2) = rng.uniform(-0.1f, 0.1f);
+    H(1, 0) = rng.uniform(-0.1f, 0.1f);
+    H(1, 1) = rng.uniform( 0.8f, 1.2f);
+    //H(1,2) = rng.uniform(-0.1f, 0.1f)*src.rows;
+    H(1, 2) = rng.uniform(-0.1f, 0.1f);
+    H(2, 0) = rng.uniform( -1e-4f, 1e-4f);
+    H(2, 1) = rng.uniform( -1e-4f, 1e-4f);
+    H(2, 2) = rng.uniform( 0.8f, 1.2f);
 
     return H;
 }
@@ -593,13 +901,19 @@ void PerspectiveTransform::transform(float t, const cv::Mat& source, cv::Mat& re
     rotateImage(source, result, 45, 90, 90, 0, 0, source.rows, source.rows);
 }
 
-cv::Mat PerspectiveTransform::getHomography(float t, const cv::Mat& source) const
+cv::Matx33d PerspectiveTransform::getHomography(float t, const cv::Size& sourceSize) const
 {
-    cv::Mat h = m_homographies[(int)t].clone();
+    cv::Matx33d h = m_homographies[(int)t];
 
-    h.at<double>(0, 2) *= source.cols;
-    h.at<double>(1, 2) *= source.rows;
+    h(0, 2) *= sourceSize.width;
+    h(1, 2) *= sourceSize.height;
 
     return h;
 }
 
+void PerspectiveTransform::writeParameters(std::ostream& str) const
+{
+    // The homographies come from a default seeded generator, so their number determines them
+    str << m_homographies.size();
+}
+
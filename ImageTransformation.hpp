@@ -2,6 +2,8 @@
 #define ImageTransformation_hpp
 
 #include <opencv2/opencv.hpp>
+#include <map>
+#include <mutex>
 
 typedef std::vector<cv::KeyPoint> Keypoints;
 typedef cv::Mat                   Descriptors;
@@ -16,15 +18,46 @@ public:
     
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result) const = 0;
 
+    //! Transformed images for all arguments of getX(), in that order. The default transforms the source
+    //! for every argument separately; transformations that can derive a step from the previous ones override it.
+    virtual void transformSweep(const cv::Mat& source, std::vector<cv::Mat>& results) const;
+
+    //! True if transformSweep is cheaper than transforming the source for every argument separately.
+    virtual bool incrementalSweep() const;
+
     virtual bool multiplyHomography() const;
-    virtual void transform(float t, const Keypoints& source, Keypoints& result) const;
 
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    //! True if transform only warps the image with getHomography into getOutputSize, so that it can be
+    //! composed with other geometric transformations into a single warp.
+    virtual bool isGeometric() const;
+
+    //! Maps keypoints of a source image of the given size into the transformed image, adapting position, scale and angle.
+    virtual void transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const;
+
+    //! Size of the transformed image for a source image of the given size.
+    virtual cv::Size getOutputSize(float t, const cv::Size& sourceSize) const;
+
+    //! Computes the homography of argument t from scratch; prefer homography(), which looks it up.
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
+
+    //! Homographies of all arguments of getX() for source images of the given size, in that order.
+    //! They are computed on first use for every size and kept, so later lookups are cheap.
+    const std::vector<cv::Matx33d>& homographies(const cv::Size& sourceSize) const;
+
+    //! Homography of argument t from the table of the source size, or computed if t is not in getX().
+    cv::Matx33d homography(float t, const cv::Size& sourceSize) const;
+
+    //! Identifies the frames of the transformation: its name, its parameters and whether they are generated
+    //! by transformSweep. Part of the feature cache keys of the frames.
+    std::string fingerprint() const;
 
     virtual ~ImageTransformation();
 
     static bool findHomography( const Keypoints& source, const Keypoints& result, const Matches& input, Matches& inliers, cv::Mat& homography);
 
+    //! Maps keypoints through a homography. Scale and angle follow the local affine approximation of the mapping at each keypoint.
+    static void projectKeypoints(const cv::Matx33d& homography, const Keypoints& source, Keypoints& result);
+
     
 protected:
 
@@ -33,6 +66,22 @@ protected:
     {
         
     }
+
+    //! Writes the parameters that determine the frames, for the fingerprint.
+    virtual void writeParameters(std::ostream& str) const;
+
+private:
+    struct HomographyTable
+    {
+        std::vector<float>       x;
+        std::vector<cv::Matx33d> homographies;
+    };
+
+    const HomographyTable& homographyTable(const cv::Size& sourceSize) const;
+
+    //! Tables by source width and height
+    mutable std::map<std::pair<int, int>, HomographyTable> m_homographyTables;
+    mutable std::mutex                                     m_homographyTablesLock;
 };
 
 class ImageRotationTransformation : public ImageTransformation
@@ -43,8 +92,13 @@ public:
 	virtual std::vector<float> getX() const;
     
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result)const ;
+    virtual void transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const;
     
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
+    virtual bool isGeometric() const;
+
+protected:
+    virtual void writeParameters(std::ostream& str) const;
 
 private:
     float m_startAngleInDeg;
@@ -63,10 +117,15 @@ public:
     
     virtual std::vector<float> getX() const;
     
+    using ImageTransformation::transform;
     virtual void transform(float t, const cv::Mat& source, cv::Mat& result)const ;
     
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
     virtual bool multiplyHomography() const;
+    virtual bool isGeometric() const;
+
+protected:
+    virtual void writeParameters(std::ostream& str) const;
 
 private:
     float m_startAngleInDeg;
@@ -85,10 +144,15 @@ public:
     
     virtual std::vector<float> getX() const;
     
+    using ImageTransformation::transform;
     virtual void transform(float t, const cv::Mat& source, cv::Mat& result)const ;
     
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
     virtual bool multiplyHomography() const;
+    virtual bool isGeometric() const;
+
+protected:
+    virtual void writeParameters(std::ostream& str) const;
 
 private:
     float m_startAngleInDeg;
@@ -108,8 +172,14 @@ public:
 	virtual std::vector<float> getX() const;
     
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result)const ;
+    virtual void transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const;
 
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    virtual cv::Size getOutputSize(float t, const cv::Size& sourceSize) const;
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
+    virtual bool isGeometric() const;
+
+protected:
+    virtual void writeParameters(std::ostream& str) const;
 
 private:
     float m_minScale;
@@ -127,6 +197,17 @@ public:
 	virtual std::vector<float> getX() const;
     
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result)const ;
+    virtual void transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const;
+
+    //! Every level is the previous one blurred further, since Gaussian kernels compose by adding their variances.
+    //! Levels up to kernel size 7 are blurred directly, since small discrete kernels compose poorly. The results
+    //! stay within 3 grey levels of blurring the source directly (checked by TransformationCheck).
+    virtual void transformSweep(const cv::Mat& source, std::vector<cv::Mat>& results) const;
+    virtual bool incrementalSweep() const;
+
+protected:
+    virtual void writeParameters(std::ostream& str) const;
+
 private:
     int m_maxKernelSize;
     std::vector<float> m_args;
@@ -140,12 +221,23 @@ public:
 	virtual std::vector<float> getX() const;
     
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result)const ;
+    virtual void transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const;
+
+    //! 8 bit images are mapped through a lookup table per argument.
+    virtual void transformSweep(const cv::Mat& source, std::vector<cv::Mat>& results) const;
+    virtual bool incrementalSweep() const;
     
+protected:
+    virtual void writeParameters(std::ostream& str) const;
+
 private:
     int m_min;
     int m_max;
     int m_step;
     std::vector<float> m_args;
+
+    //! Saturated source + argument for every 8 bit value, one table per argument.
+    std::vector<cv::Mat> m_lookupTables;
 };
 
 class CombinedTransform : public ImageTransformation
@@ -170,16 +262,25 @@ public:
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result) const ;
 
     virtual bool multiplyHomography() const;
-    virtual void transform(float t, const Keypoints& source, Keypoints& result) const;
+    virtual bool isGeometric() const;
+    virtual void transform(float t, const cv::Size& sourceSize, const Keypoints& source, Keypoints& result) const;
     
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    virtual cv::Size getOutputSize(float t, const cv::Size& sourceSize) const;
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
     
+protected:
+    virtual void writeParameters(std::ostream& str) const;
+
 private:
+    //! True if the homography makes the source smaller, so that a single warp would alias it.
+    static bool shrinks(const cv::Matx33d& h);
+
     std::vector< float >                   m_x;
     std::vector< std::pair<float, float> > m_params;
     
     cv::Ptr<ImageTransformation> m_first;
     cv::Ptr<ImageTransformation> m_second;
+    ParamCombinationType         m_type;
 };
 
 class PerspectiveTransform : public ImageTransformation
@@ -189,12 +290,16 @@ public:
     
 	virtual std::vector<float> getX() const;
     
+	using ImageTransformation::transform;
 	virtual void transform(float t, const cv::Mat& source, cv::Mat& result) const;
     
-    virtual cv::Mat getHomography(float t, const cv::Mat& source) const;
+    virtual cv::Matx33d getHomography(float t, const cv::Size& sourceSize) const;
     
+protected:
+    virtual void writeParameters(std::ostream& str) const;
+
 private:
-    static cv::Mat warpPerspectiveRand( cv::RNG& rng );
+    static cv::Matx33d warpPerspectiveRand( cv::RNG& rng );
     
     float m_min;
     float m_max;
@@ -202,7 +307,7 @@ private:
     
     std::vector<float>   m_args;
 
-    std::vector<cv::Mat> m_homographies;
+    std::vector<cv::Matx33d> m_homographies;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "KeypointGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+KeypointGrid::KeypointGrid(const std::vector<cv::KeyPoint>& keypoints_, cv::Size imageSize, float radius_)
+: keypoints(keypoints_)
+, radius(radius_)
+, columns(std::max(1, static_cast<int>(std::ceil(imageSize.width / radius_))))
+, rows(std::max(1, static_cast<int>(std::ceil(imageSize.height / radius_))))
+{
+    CV_Assert(radius > 0);
+
+    const int cells = columns * rows;
+    std::vector<int> keypointCells(keypoints.size());
+
+    cellStart.assign(cells + 1, 0);
+    for (size_t i = 0; i < keypoints.size(); i++)
+    {
+        keypointCells[i] = cellOf(keypoints[i].pt.y, rows) * columns + cellOf(keypoints[i].pt.x, columns);
+        cellStart[keypointCells[i] + 1]++;
+    }
+
+    for (int cell = 0; cell < cells; cell++)
+        cellStart[cell + 1] += cellStart[cell];
+
+    std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+    cellKeypoints.resize(keypoints.size());
+
+    for (size_t i = 0; i < keypoints.size(); i++)
+        cellKeypoints[next[keypointCells[i]]++] = static_cast<int>(i);
+}
+
+int KeypointGrid::cellOf(float coordinate, int cells) const
+{
+    const int cell = static_cast<int>(std::floor(coordinate / radius));
+    return std::min(std::max(cell, 0), cells - 1);
+}
+
+int KeypointGrid::nearest(const cv::Point2f& point, const std::vector<bool>& taken) const
+{
+    const int column = cellOf(point.x, columns);
+    const int row    = cellOf(point.y, rows);
+
+    int   best         = -1;
+    float bestDistance = radius * radius;
+
+    for (int y = std::max(row - 1, 0); y <= std::min(row + 1, rows - 1); y++)
+    {
+        for (int x = std::max(column - 1, 0); x <= std::min(column + 1, columns - 1); x++)
+        {
+            const int cell = y * columns + x;
+
+            for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+            {
+                const int i = cellKeypoints[k];
+                if (taken[i])
+                    continue;
+
+                const cv::Point2f d = keypoints[i].pt - point;
+                const float distance = d.dot(d);
+
+                if (distance < bestDistance || (best >= 0 && distance == bestDistance && i < best))
+                {
+                    bestDistance = distance;
+                    best         = i;
+                }
+            }
+        }
+    }
+
+    return best;
+}
+
+float computeRepeatability(const std::vector<cv::Point2f>& sourcePointsInFrame, const std::vector<cv::KeyPoint>& frameKeypoints,
+                           cv::Size frameSize, float radius, int& sharedKeypoints)
+{
+    const KeypointGrid grid(frameKeypoints, frameSize, radius);
+    std::vector<bool> taken(frameKeypoints.size(), false);
+
+    int visible         = 0;
+    int correspondences = 0;
+
+    for (size_t i = 0; i < sourcePointsInFrame.size(); i++)
+    {
+        const cv::Point2f& p = sourcePointsInFrame[i];
+        if (!(p.x > 0 && p.y > 0 && p.x < frameSize.width && p.y < frameSize.height))
+            continue;
+
+        visible++;
+
+        const int nearest = grid.nearest(p, taken);
+        if (nearest >= 0)
+        {
+            taken[nearest] = true;
+            correspondences++;
+        }
+    }
+
+    sharedKeypoints = std::min(visible, static_cast<int>(frameKeypoints.size()));
+
+    return sharedKeypoints > 0 ? correspondences / static_cast<float>(sharedKeypoints) : 0;
+}
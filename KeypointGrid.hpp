@@ -0,0 +1,39 @@
+#ifndef KeypointGrid_hpp
+#define KeypointGrid_hpp
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+//! Uniform grid over the keypoints of an image for fixed radius nearest neighbour queries.
+//! Cells are as wide as the radius, so a query only looks at the 3x3 cells around the point and
+//! both building the grid and every query take time linear in the number of nearby keypoints.
+class KeypointGrid
+{
+public:
+    KeypointGrid(const std::vector<cv::KeyPoint>& keypoints, cv::Size imageSize, float radius);
+
+    //! Index of the keypoint nearest to point that is closer than the radius and not yet taken,
+    //! or -1. Ties go to the lower index.
+    int nearest(const cv::Point2f& point, const std::vector<bool>& taken) const;
+
+private:
+    int cellOf(float coordinate, int cells) const;
+
+    const std::vector<cv::KeyPoint>& keypoints;
+    float            radius;
+    int              columns;
+    int              rows;
+
+    //! Keypoint indices sorted by cell, and the start of every cell among them (compressed sparse rows).
+    std::vector<int> cellStart;
+    std::vector<int> cellKeypoints;
+};
+
+//! Fraction of the source keypoints that reappear in the frame: every visible projected source point
+//! is paired with the nearest frame keypoint within radius pixels that is not paired yet, and the pairs
+//! are divided by the smaller of the visible source keypoints and the frame keypoints, which is
+//! returned in sharedKeypoints. Returns 0 if either is empty.
+float computeRepeatability(const std::vector<cv::Point2f>& sourcePointsInFrame, const std::vector<cv::KeyPoint>& frameKeypoints,
+                           cv::Size frameSize, float radius, int& sharedKeypoints);
+
+#endif
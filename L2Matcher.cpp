@@ -0,0 +1,430 @@
+#include "L2Matcher.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define L2_X86_KERNELS 1
+#endif
+
+const int L2Matcher::PanelRows;
+
+// Tile of the distance kernel: QueryRows query descriptors against one panel of train descriptors
+static const int QueryRows = 4;
+static const int PanelRows = L2Matcher::PanelRows;
+
+// Train rows kept hot while all query descriptors stream past them
+static const int BlockRows = 8 * PanelRows;
+
+typedef void (*DotKernel)(const float* const* queries, const float* panel, int dims, float* dots);
+
+#pragma mark - Dot product kernels
+
+// dots[r * PanelRows + c] is the dot product of queries[r] with train row c of the panel
+static void dotsScalar(const float* const* queries, const float* panel, int dims, float* dots)
+{
+    std::fill(dots, dots + QueryRows * PanelRows, 0.0f);
+
+    for (int k = 0; k < dims; k++)
+    {
+        const float* t = panel + k * PanelRows;
+
+        for (int r = 0; r < QueryRows; r++)
+        {
+            const float q = queries[r][k];
+            for (int c = 0; c < PanelRows; c++)
+                dots[r * PanelRows + c] += q * t[c];
+        }
+    }
+}
+
+#if defined(L2_X86_KERNELS)
+
+// Outer product update: one broadcast query element times a full panel column per query row
+__attribute__((target("avx2,fma")))
+static void dotsAvx2(const float* const* queries, const float* panel, int dims, float* dots)
+{
+    const float* q0 = queries[0];
+    const float* q1 = queries[1];
+    const float* q2 = queries[2];
+    const float* q3 = queries[3];
+
+    __m256 d0 = _mm256_setzero_ps(), d1 = d0, d2 = d0, d3 = d0;
+
+    for (int k = 0; k < dims; k++)
+    {
+        const __m256 t = _mm256_loadu_ps(panel + k * PanelRows);
+        d0 = _mm256_fmadd_ps(_mm256_set1_ps(q0[k]), t, d0);
+        d1 = _mm256_fmadd_ps(_mm256_set1_ps(q1[k]), t, d1);
+        d2 = _mm256_fmadd_ps(_mm256_set1_ps(q2[k]), t, d2);
+        d3 = _mm256_fmadd_ps(_mm256_set1_ps(q3[k]), t, d3);
+    }
+
+    _mm256_storeu_ps(dots,                 d0);
+    _mm256_storeu_ps(dots + PanelRows,     d1);
+    _mm256_storeu_ps(dots + 2 * PanelRows, d2);
+    _mm256_storeu_ps(dots + 3 * PanelRows, d3);
+}
+
+#endif
+
+struct SelectedDotKernel
+{
+    DotKernel   kernel;
+    const char* name;
+};
+
+static SelectedDotKernel selectKernel()
+{
+    SelectedDotKernel selected = { dotsScalar, "scalar" };
+
+#if defined(L2_X86_KERNELS)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        selected.kernel = dotsAvx2;
+        selected.name   = "avx2";
+    }
+#endif
+
+    return selected;
+}
+
+static const SelectedDotKernel& kernel()
+{
+    static const SelectedDotKernel selected = selectKernel();
+    return selected;
+}
+
+#pragma mark - L2Matcher implementation
+
+void L2Matcher::prepare(const cv::Mat& train, PreparedTrain& prepared)
+{
+    CV_Assert(train.empty() || train.type() == CV_32F);
+
+    const int dims   = train.cols;
+    const int panels = (train.rows + PanelRows - 1) / PanelRows;
+
+    prepared.descriptors = train;
+    prepared.panels.assign(static_cast<size_t>(panels) * PanelRows * dims, 0.0f);
+    prepared.norms.resize(train.rows);
+
+    for (int j = 0; j < train.rows; j++)
+    {
+        const float* row = train.ptr<float>(j);
+        float* column = &prepared.panels[static_cast<size_t>(j / PanelRows) * PanelRows * dims + j % PanelRows];
+
+        float norm = 0;
+        for (int k = 0; k < dims; k++)
+        {
+            column[k * PanelRows] = row[k];
+            norm += row[k] * row[k];
+        }
+
+        prepared.norms[j] = norm;
+    }
+}
+
+void L2Matcher::crossCheckMatch(const cv::Mat& query, const cv::Mat& train, std::vector<cv::DMatch>& matches)
+{
+    PreparedTrain prepared;
+    prepare(train, prepared);
+    crossCheckMatch(query, prepared, matches);
+}
+
+// Rows that may still be among the nearest, with the lower bounds of their squared distances
+typedef std::vector<std::pair<int, float> > Candidates;
+
+// Keeps the candidates whose lower bound does not exceed the bound a nearest row must meet
+static void pruneCandidates(Candidates& candidates, float upper)
+{
+    size_t kept = 0;
+    for (size_t k = 0; k < candidates.size(); k++)
+    {
+        if (candidates[k].second <= upper)
+            candidates[kept++] = candidates[k];
+    }
+    candidates.resize(kept);
+}
+
+// Adds a candidate, pruning the list whenever it has doubled since the last time
+static inline void addCandidate(Candidates& candidates, size_t& pruneAt, int row, float lower, float upper)
+{
+    candidates.push_back(std::make_pair(row, lower));
+
+    if (candidates.size() >= pruneAt)
+    {
+        pruneCandidates(candidates, upper);
+        pruneAt = std::max<size_t>(32, 2 * candidates.size());
+    }
+}
+
+// Runs the dot product kernel over all pairs of query and train descriptors, block of train rows by
+// block, and hands the bounds of every squared distance to bounds.add(i, j, lower, upper). For any
+// query row, train rows arrive in increasing order, and for any train row query rows do.
+// bounds.endBlock(firstRow, blockRows) is called after every block.
+template <typename Bounds>
+static void boundDistances(const cv::Mat& query, const L2Matcher::PreparedTrain& prepared, Bounds& bounds)
+{
+    const cv::Mat& train = prepared.descriptors;
+    const int dims = query.cols;
+
+    // Bounds the rounding error of both the decomposed distance and the one computed by OpenCV,
+    // relative to ||a||^2 + ||b||^2
+    const float slack = (4 * dims + 16) * (FLT_EPSILON / 2);
+
+    std::vector<float> queryNorms(query.rows);
+    for (int i = 0; i < query.rows; i++)
+    {
+        const float* row = query.ptr<float>(i);
+
+        float norm = 0;
+        for (int k = 0; k < dims; k++)
+            norm += row[k] * row[k];
+
+        queryNorms[i] = norm;
+    }
+
+    // Stands in for the missing rows of the last group of query descriptors
+    const std::vector<float> zeros(dims, 0.0f);
+
+    const DotKernel dotKernel = kernel().kernel;
+    float dots[QueryRows * PanelRows];
+
+    for (int firstRow = 0; firstRow < train.rows; firstRow += BlockRows)
+    {
+        const int blockRows = std::min(BlockRows, train.rows - firstRow);
+
+        for (int firstQuery = 0; firstQuery < query.rows; firstQuery += QueryRows)
+        {
+            const int groupRows = std::min(QueryRows, query.rows - firstQuery);
+
+            const float* queries[QueryRows];
+            for (int r = 0; r < QueryRows; r++)
+                queries[r] = r < groupRows ? query.ptr<float>(firstQuery + r) : &zeros[0];
+
+            for (int panelFirst = firstRow; panelFirst < firstRow + blockRows; panelFirst += PanelRows)
+            {
+                dotKernel(queries, &prepared.panels[static_cast<size_t>(panelFirst) * dims], dims, dots);
+
+                const int panelRows = std::min(PanelRows, firstRow + blockRows - panelFirst);
+                for (int c = 0; c < panelRows; c++)
+                {
+                    const float trainNorm = prepared.norms[panelFirst + c];
+
+                    for (int r = 0; r < groupRows; r++)
+                    {
+                        const float sum    = queryNorms[firstQuery + r] + trainNorm;
+                        const float approx = sum - 2 * dots[r * PanelRows + c];
+                        const float margin = slack * sum;
+
+                        bounds.add(firstQuery + r, panelFirst + c, approx - margin, approx + margin);
+                    }
+                }
+            }
+        }
+
+        bounds.endBlock(firstRow, blockRows);
+    }
+}
+
+// Nearest query row of every train row, for the cross check
+struct NearestQueryBounds
+{
+    NearestQueryBounds(const cv::Mat& query, const cv::Mat& train)
+    : query(query)
+    , train(train)
+    , nearestQuery(train.rows, -1)
+    , nearestQueryDistance(train.rows, FLT_MAX)
+    , upper(BlockRows, FLT_MAX)
+    , candidates(BlockRows)
+    , pruneAt(BlockRows, 32)
+    , firstRow(0)
+    {
+    }
+
+    void add(int i, int j, float lower, float upperBound)
+    {
+        const int col = j - firstRow;
+
+        if (lower <= upper[col])
+        {
+            upper[col] = std::min(upper[col], upperBound);
+            addCandidate(candidates[col], pruneAt[col], i, lower, upper[col]);
+        }
+    }
+
+    // Exact distances for the remaining candidates, in increasing query order so that ties go to the lower index
+    void endBlock(int blockFirstRow, int blockRows)
+    {
+        for (int col = 0; col < blockRows; col++)
+        {
+            const int    j        = blockFirstRow + col;
+            const float* trainRow = train.ptr<float>(j);
+
+            for (size_t k = 0; k < candidates[col].size(); k++)
+            {
+                if (candidates[col][k].second > upper[col])
+                    continue;
+
+                const int   i = candidates[col][k].first;
+                const float d = std::sqrt(cv::normL2Sqr_(trainRow, query.ptr<float>(i), query.cols));
+
+                if (d < nearestQueryDistance[j])
+                {
+                    nearestQueryDistance[j] = d;
+                    nearestQuery[j]         = i;
+                }
+            }
+
+            upper[col] = FLT_MAX;
+            candidates[col].clear();
+            pruneAt[col] = 32;
+        }
+
+        firstRow = blockFirstRow + blockRows;
+    }
+
+    const cv::Mat&          query;
+    const cv::Mat&          train;
+
+    std::vector<int>        nearestQuery;
+    std::vector<float>      nearestQueryDistance;
+
+    // Per train row of the block: smallest upper bound so far and the queries that may still beat it
+    std::vector<float>      upper;
+    std::vector<Candidates> candidates;
+    std::vector<size_t>     pruneAt;
+    int                     firstRow;
+};
+
+// Two nearest train rows of every query row, for the ratio test
+struct NearestTrainBounds
+{
+    NearestTrainBounds(int queryRows)
+    : nearestUpper(queryRows, FLT_MAX)
+    , secondUpper(queryRows, FLT_MAX)
+    , candidates(queryRows)
+    , pruneAt(queryRows, 32)
+    {
+    }
+
+    // The second smallest upper bound bounds the distance of both nearest rows
+    void add(int i, int j, float lower, float upper)
+    {
+        if (lower > secondUpper[i])
+            return;
+
+        if (upper < nearestUpper[i])
+        {
+            secondUpper[i]  = nearestUpper[i];
+            nearestUpper[i] = upper;
+        }
+        else if (upper < secondUpper[i])
+        {
+            secondUpper[i] = upper;
+        }
+
+        addCandidate(candidates[i], pruneAt[i], j, lower, secondUpper[i]);
+    }
+
+    void endBlock(int, int)
+    {
+    }
+
+    std::vector<float>      nearestUpper;
+    std::vector<float>      secondUpper;
+    std::vector<Candidates> candidates;
+    std::vector<size_t>     pruneAt;
+};
+
+void L2Matcher::crossCheckMatch(const cv::Mat& query, const PreparedTrain& prepared, std::vector<cv::DMatch>& matches)
+{
+    matches.clear();
+
+    const cv::Mat& train = prepared.descriptors;
+    if (query.empty() || train.empty())
+        return;
+
+    CV_Assert(query.type() == CV_32F && train.type() == CV_32F && query.cols == train.cols);
+
+    NearestQueryBounds bounds(query, train);
+    boundDistances(query, prepared, bounds);
+
+    // Every query descriptor keeps the nearest train descriptor among those that picked it
+    std::vector<int>   matchedTrain(query.rows, -1);
+    std::vector<float> matchedDistance(query.rows, FLT_MAX);
+
+    for (int j = 0; j < train.rows; j++)
+    {
+        const int i = bounds.nearestQuery[j];
+        if (i >= 0 && bounds.nearestQueryDistance[j] < matchedDistance[i])
+        {
+            matchedDistance[i] = bounds.nearestQueryDistance[j];
+            matchedTrain[i]    = j;
+        }
+    }
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        if (matchedTrain[i] >= 0)
+            matches.push_back(cv::DMatch(i, matchedTrain[i], matchedDistance[i]));
+    }
+}
+
+void L2Matcher::ratioMatch(const cv::Mat& query, const PreparedTrain& prepared, float maxRatio, std::vector<cv::DMatch>& matches)
+{
+    matches.clear();
+
+    const cv::Mat& train = prepared.descriptors;
+    if (query.empty() || train.empty())
+        return;
+
+    CV_Assert(query.type() == CV_32F && train.type() == CV_32F && query.cols == train.cols);
+
+    NearestTrainBounds bounds(query.rows);
+    boundDistances(query, prepared, bounds);
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        const float* queryRow = query.ptr<float>(i);
+        const Candidates& candidates = bounds.candidates[i];
+
+        int   nearestRow = -1;
+        float nearest    = FLT_MAX;
+        float second     = FLT_MAX;
+
+        // Exact distances in increasing train order, inserted the way cv::BFMatcher keeps its k nearest
+        for (size_t k = 0; k < candidates.size(); k++)
+        {
+            if (candidates[k].second > bounds.secondUpper[i])
+                continue;
+
+            const int   j = candidates[k].first;
+            const float d = std::sqrt(cv::normL2Sqr_(train.ptr<float>(j), queryRow, query.cols));
+
+            if (d < nearest)
+            {
+                second     = nearest;
+                nearest    = d;
+                nearestRow = j;
+            }
+            else if (d < second)
+            {
+                second = d;
+            }
+        }
+
+        // A single train row leaves no second neighbour to compare to
+        if (train.rows > 1 && nearestRow >= 0 && nearest < maxRatio * second)
+            matches.push_back(cv::DMatch(i, nearestRow, nearest));
+    }
+}
+
+const char* L2Matcher::kernelName()
+{
+    return kernel().name;
+}
@@ -0,0 +1,43 @@
+#ifndef L2Matcher_hpp
+#define L2Matcher_hpp
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+//! Exact brute force matcher for float descriptors (CV_32F rows compared by Euclidean distance).
+//! Squared distances are first bounded through ||a||^2 + ||b||^2 - 2ab, with the dot products
+//! computed by a cache-blocked, vectorized matrix multiply. Only the rows that the bounds cannot
+//! rule out are then compared exactly, the same way cv::BFMatcher does.
+class L2Matcher
+{
+public:
+    //! Train descriptors in the layout of the distance kernel, together with their squared norms.
+    struct PreparedTrain
+    {
+        cv::Mat            descriptors;
+
+        //! Groups of PanelRows rows stored column by column; the last group is padded with zeros.
+        std::vector<float> panels;
+        std::vector<float> norms;
+    };
+
+    static const int PanelRows = 8;
+
+    //! Packs train once, so that it can be matched against any number of query sets.
+    static void prepare(const cv::Mat& train, PreparedTrain& prepared);
+
+    //! Cross-checked matches of query against train, identical to those of cv::BFMatcher(NORM_L2, true),
+    //! including distances and ties.
+    static void crossCheckMatch(const cv::Mat& query, const PreparedTrain& train, std::vector<cv::DMatch>& matches);
+    static void crossCheckMatch(const cv::Mat& query, const cv::Mat& train, std::vector<cv::DMatch>& matches);
+
+    //! Nearest train descriptor of every query descriptor that passes the ratio test, identical to
+    //! cv::BFMatcher(NORM_L2).knnMatch with k = 2 followed by the ratio test. Only rows that the bounds
+    //! cannot rule out of the two nearest are compared exactly, and no neighbour lists are stored.
+    static void ratioMatch(const cv::Mat& query, const PreparedTrain& train, float maxRatio, std::vector<cv::DMatch>& matches);
+
+    //! Name of the dot product kernel selected for this CPU.
+    static const char* kernelName();
+};
+
+#endif
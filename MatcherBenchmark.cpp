@@ -0,0 +1,255 @@
+#include "HammingMatcher.hpp"
+#include "L2Matcher.hpp"
+#include "MultiIndexHashing.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+typedef std::vector<cv::DMatch> Matches;
+typedef std::function<void(const cv::Mat&, const cv::Mat&, Matches&)> MatchFunction;
+
+//! Best of a few runs, in milliseconds; fewer for large sets.
+static double timeMatcher(const MatchFunction& match, const cv::Mat& query, const cv::Mat& train, Matches& matches)
+{
+    const int runs = static_cast<double>(query.rows) * train.rows > 1e8 ? 2 : 5;
+    double best = 0;
+
+    for (int run = 0; run < runs; run++)
+    {
+        int64 start = cv::getTickCount();
+        match(query, train, matches);
+        double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+
+        best = run == 0 ? ms : std::min(best, ms);
+    }
+
+    return best;
+}
+
+static bool sameMatches(const Matches& a, const Matches& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].queryIdx != b[i].queryIdx || a[i].trainIdx != b[i].trainIdx || a[i].distance != b[i].distance)
+            return false;
+    }
+
+    return true;
+}
+
+//! Prints a row of the table and returns identical.
+static bool printRow(const std::string& matcher, int bytes, int count, double ms, double referenceMs, bool identical)
+{
+    std::cout << std::setw(10) << matcher << std::setw(8) << bytes << std::setw(8) << count
+              << std::setw(12) << std::fixed << std::setprecision(2) << ms
+              << std::setw(10) << std::setprecision(2) << referenceMs / ms << "x"
+              << std::setw(10) << (identical ? "yes" : "NO") << std::endl;
+    return identical;
+}
+
+//! Random binary descriptors where every nearEvery-th train descriptor is a copy of a query descriptor with
+//! flips random bits flipped (a bit can be picked twice), like the descriptors of the same point in two views.
+static void makeBinaryPair(int count, int bytes, int nearEvery, int flips, cv::RNG& rng, cv::Mat& query, cv::Mat& train)
+{
+    query.create(count, bytes, CV_8U);
+    train.create(count, bytes, CV_8U);
+    rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+    rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+
+    for (int j = 0; j < train.rows; j += nearEvery)
+    {
+        std::memcpy(train.ptr(j), query.ptr(rng.uniform(0, query.rows)), bytes);
+
+        for (int flip = 0; flip < flips; flip++)
+            train.ptr(j)[rng.uniform(0, bytes)] ^= static_cast<uchar>(1 << rng.uniform(0, 8));
+    }
+}
+
+//! cv::BFMatcher knnMatch with k = 2 followed by the ratio test of the evaluation.
+static void knnRatioMatch(cv::BFMatcher& matcher, const cv::Mat& query, const cv::Mat& train, float maxRatio, Matches& matches)
+{
+    std::vector<Matches> knMatches;
+    matcher.knnMatch(query, train, knMatches, 2);
+
+    matches.clear();
+    for (size_t i = 0; i < knMatches.size(); i++)
+    {
+        if (knMatches[i].size() >= 2 && knMatches[i][0].distance < maxRatio * knMatches[i][1].distance)
+            matches.push_back(knMatches[i][0]);
+    }
+}
+
+//! Train descriptors of which every other one is a noisy copy of a query descriptor, so that a fair share
+//! of the query descriptors pass the ratio test.
+static void makeRatioTrain(const cv::Mat& query, int rows, cv::RNG& rng, cv::Mat& train)
+{
+    train.create(rows, query.cols, query.type());
+
+    if (query.type() == CV_8U)
+        rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+    else
+        rng.fill(train, cv::RNG::UNIFORM, 0.f, 1.f);
+
+    for (int j = 0; j < train.rows; j += 2)
+    {
+        query.row(rng.uniform(0, query.rows)).copyTo(train.row(j));
+
+        if (query.type() == CV_8U)
+        {
+            for (int flip = 0; flip < query.cols; flip++)
+                train.ptr(j)[rng.uniform(0, query.cols)] ^= static_cast<uchar>(1 << rng.uniform(0, 8));
+        }
+        else
+        {
+            for (int k = 0; k < query.cols; k++)
+                train.ptr<float>(j)[k] += rng.uniform(-0.05f, 0.05f);
+        }
+    }
+}
+
+//! Times the in-tree matchers against cv::BFMatcher with cross check, and the ratio matchers against
+//! knnMatch with the ratio test, on random descriptors and verifies that they return the same matches.
+int main(int argc, const char* argv[])
+{
+    const int counts[] = { 500, 1000, 2000, 5000 };
+    cv::RNG rng(0x5eed);
+
+    std::cout << "Hamming kernel: " << HammingMatcher::kernelName() << ", L2 kernel: " << L2Matcher::kernelName() << std::endl;
+    std::cout << std::setw(10) << "Matcher" << std::setw(8) << "Bytes" << std::setw(8) << "Count"
+              << std::setw(12) << "Time ms" << std::setw(11) << "Speedup" << std::setw(10) << "Same" << std::endl;
+
+    const int binaryBytes[] = { 32, 64 };
+    bool      allSame       = true;
+
+    // Every other train descriptor is a close copy of a query descriptor with an eighth of its bits flipped.
+    // The largest count is the first where multi-index hashing indexes 256 bit descriptors; near duplicates
+    // (every train descriptor a copy with a thirty-second of its bits flipped) are where it does best.
+    struct BinaryCase
+    {
+        int count;
+        int nearEvery;
+        int flipsPer64Bits;
+    };
+    const BinaryCase binaryCases[] = { { 500, 2, 8 }, { 1000, 2, 8 }, { 2000, 2, 8 }, { 5000, 2, 8 }, { 20000, 2, 8 }, { 20000, 1, 2 } };
+
+    for (size_t b = 0; b < sizeof(binaryBytes) / sizeof(binaryBytes[0]); b++)
+    {
+        for (size_t c = 0; c < sizeof(binaryCases) / sizeof(binaryCases[0]); c++)
+        {
+            const BinaryCase& binaryCase = binaryCases[c];
+
+            cv::Mat query, train;
+            makeBinaryPair(binaryCase.count, binaryBytes[b], binaryCase.nearEvery, binaryBytes[b] / 8 * binaryCase.flipsPer64Bits, rng, query, train);
+
+            cv::BFMatcher bruteForce(cv::NORM_HAMMING, true);
+            Matches reference, matches;
+
+            double referenceMs = timeMatcher([&](const cv::Mat& q, const cv::Mat& t, Matches& m) { bruteForce.match(q, t, m); },
+                                             query, train, reference);
+            printRow("BFMatcher", binaryBytes[b], binaryCase.count, referenceMs, referenceMs, true);
+
+            double ms = timeMatcher(HammingMatcher::crossCheckMatch, query, train, matches);
+            allSame &= printRow("Hamming", binaryBytes[b], binaryCase.count, ms, referenceMs, sameMatches(reference, matches));
+
+            // Below this size it would only run the Hamming matcher again
+            if (MultiIndexHashing::indexPays(query))
+            {
+                ms = timeMatcher(MultiIndexHashing::crossCheckMatch, query, train, matches);
+                allSame &= printRow(binaryCase.nearEvery == 1 ? "MIH near" : "MIH", binaryBytes[b], binaryCase.count, ms, referenceMs,
+                                    sameMatches(reference, matches));
+            }
+        }
+    }
+
+    // Float descriptors of SURF (64) and SIFT (128), with the column width reported in bytes
+    const int floatDims[] = { 64, 128 };
+
+    for (size_t d = 0; d < sizeof(floatDims) / sizeof(floatDims[0]); d++)
+    {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        {
+            cv::Mat query(counts[c], floatDims[d], CV_32F), train(counts[c], floatDims[d], CV_32F);
+            rng.fill(query, cv::RNG::UNIFORM, 0.f, 1.f);
+            rng.fill(train, cv::RNG::UNIFORM, 0.f, 1.f);
+
+            cv::BFMatcher bruteForce(cv::NORM_L2, true);
+            Matches reference, matches;
+
+            double referenceMs = timeMatcher([&](const cv::Mat& q, const cv::Mat& t, Matches& m) { bruteForce.match(q, t, m); },
+                                             query, train, reference);
+            printRow("BFMatcher", floatDims[d] * 4, counts[c], referenceMs, referenceMs, true);
+
+            MatchFunction l2 = [](const cv::Mat& q, const cv::Mat& t, Matches& m) { L2Matcher::crossCheckMatch(q, t, m); };
+            double ms = timeMatcher(l2, query, train, matches);
+            allSame &= printRow("L2", floatDims[d] * 4, counts[c], ms, referenceMs, sameMatches(reference, matches));
+        }
+    }
+
+    // Ratio matchers against knnMatch with k = 2 and the ratio test, on 2000 query descriptors. Count is the
+    // number of train descriptors; a single one leaves no second neighbour, so nothing may pass. The largest
+    // count is indexed by multi-index hashing.
+    const float maxRatio    = 0.8f;
+    const int   ratioRows[] = { 1, 2000, 20000 };
+
+    for (size_t r = 0; r < sizeof(ratioRows) / sizeof(ratioRows[0]); r++)
+    {
+        for (size_t b = 0; b < sizeof(binaryBytes) / sizeof(binaryBytes[0]); b++)
+        {
+            cv::Mat query(2000, binaryBytes[b], CV_8U), train;
+            rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+            makeRatioTrain(query, ratioRows[r], rng, train);
+
+            cv::BFMatcher bruteForce(cv::NORM_HAMMING);
+            Matches reference, matches;
+
+            double referenceMs = timeMatcher([&](const cv::Mat& q, const cv::Mat& t, Matches& m) { knnRatioMatch(bruteForce, q, t, maxRatio, m); },
+                                             query, train, reference);
+            printRow("BFRatio", binaryBytes[b], ratioRows[r], referenceMs, referenceMs, true);
+
+            double ms = timeMatcher([&](const cv::Mat& q, const cv::Mat& t, Matches& m) { HammingMatcher::ratioMatch(q, t, maxRatio, m); },
+                                    query, train, matches);
+            allSame &= printRow("HamRatio", binaryBytes[b], ratioRows[r], ms, referenceMs, sameMatches(reference, matches));
+
+            if (MultiIndexHashing::indexPays(train))
+            {
+                // Indexing the train set is part of the cost, as in a single use
+                MatchFunction mih = [&](const cv::Mat& q, const cv::Mat& t, Matches& m) { MultiIndexHashing(t).ratioMatch(q, maxRatio, m); };
+                ms = timeMatcher(mih, query, train, matches);
+                allSame &= printRow("MIHRatio", binaryBytes[b], ratioRows[r], ms, referenceMs, sameMatches(reference, matches));
+            }
+        }
+
+        for (size_t d = 0; d < sizeof(floatDims) / sizeof(floatDims[0]); d++)
+        {
+            cv::Mat query(2000, floatDims[d], CV_32F), train;
+            rng.fill(query, cv::RNG::UNIFORM, 0.f, 1.f);
+            makeRatioTrain(query, ratioRows[r], rng, train);
+
+            cv::BFMatcher bruteForce(cv::NORM_L2);
+            Matches reference, matches;
+
+            double referenceMs = timeMatcher([&](const cv::Mat& q, const cv::Mat& t, Matches& m) { knnRatioMatch(bruteForce, q, t, maxRatio, m); },
+                                             query, train, reference);
+            printRow("BFRatio", floatDims[d] * 4, ratioRows[r], referenceMs, referenceMs, true);
+
+            // Preparing the train set is part of the cost, as in a single use
+            MatchFunction l2 = [&](const cv::Mat& q, const cv::Mat& t, Matches& m)
+            {
+                L2Matcher::PreparedTrain prepared;
+                L2Matcher::prepare(t, prepared);
+                L2Matcher::ratioMatch(q, prepared, maxRatio, m);
+            };
+            double ms = timeMatcher(l2, query, train, matches);
+            allSame &= printRow("L2Ratio", floatDims[d] * 4, ratioRows[r], ms, referenceMs, sameMatches(reference, matches));
+        }
+    }
+
+    return allSame ? 0 : 1;
+}
@@ -0,0 +1,353 @@
+#include "MultiIndexHashing.hpp"
+#include "HammingMatcher.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+const int MultiIndexHashing::SubstringBits;
+
+static const int TableSize = 1 << MultiIndexHashing::SubstringBits;
+
+// A bucket lookup and the distances to the rows it lists cost about as much as 25 (512 bit) to 35 (256 bit)
+// distances of a linear scan, which streams through memory. This is how many of the latter one of the former costs.
+static const int ProbeCost = 32;
+
+
+static inline uint16_t substring(const uchar* descriptor, int k)
+{
+    uint16_t value;
+    std::memcpy(&value, descriptor + k * sizeof(value), sizeof(value));
+    return value;
+}
+
+// Substring values are spread over the buckets by a multiplicative hash, a bijection when there are as many buckets as values
+static inline int bucketOf(unsigned value, int bucketBits)
+{
+    return static_cast<uint16_t>(value * 0x9E37u) >> (MultiIndexHashing::SubstringBits - bucketBits);
+}
+
+// All substring values ordered by number of set bits, with the start of every weight
+struct MasksByWeight
+{
+    std::vector<uint16_t> masks;
+    int                   begin[MultiIndexHashing::SubstringBits + 2];
+
+    MasksByWeight()
+    : masks(TableSize)
+    {
+        std::vector<int> weights(TableSize);
+        std::fill(begin, begin + MultiIndexHashing::SubstringBits + 2, 0);
+
+        for (int mask = 1; mask < TableSize; mask++)
+        {
+            weights[mask] = weights[mask & (mask - 1)] + 1;
+            begin[weights[mask] + 1]++;
+        }
+        begin[1]++;
+
+        for (int weight = 0; weight <= MultiIndexHashing::SubstringBits; weight++)
+            begin[weight + 1] += begin[weight];
+
+        std::vector<int> next(begin, begin + MultiIndexHashing::SubstringBits + 1);
+        for (int mask = 0; mask < TableSize; mask++)
+            masks[next[weights[mask]]++] = static_cast<uint16_t>(mask);
+    }
+};
+
+static const MasksByWeight& masksByWeight()
+{
+    static const MasksByWeight masks;
+    return masks;
+}
+
+// Copies of the given rows, so that the descriptors the index could not resolve are scanned together
+static cv::Mat gatherRows(const cv::Mat& descriptors, const std::vector<int>& rows)
+{
+    cv::Mat gathered(static_cast<int>(rows.size()), descriptors.cols, descriptors.type());
+    for (size_t i = 0; i < rows.size(); i++)
+        std::memcpy(gathered.ptr(static_cast<int>(i)), descriptors.ptr(rows[i]), descriptors.cols);
+
+    return gathered;
+}
+
+#pragma mark - MultiIndexHashing implementation
+
+MultiIndexHashing::Scratch::Scratch()
+: stamp(0)
+{
+}
+
+bool MultiIndexHashing::supports(const cv::Mat& descriptors)
+{
+    return descriptors.type() == CV_8U && descriptors.cols > 0 && descriptors.cols * 8 % SubstringBits == 0;
+}
+
+bool MultiIndexHashing::indexPays(const cv::Mat& descriptors)
+{
+    // Probing stops at the radius where it would cost more than a linear scan, so unless the scan is
+    // long enough to afford probing radius 1, every search would end up scanning
+    const int substrings = descriptors.cols * 8 / SubstringBits;
+    return supports(descriptors) && descriptors.rows >= ProbeCost * substrings * (1 + SubstringBits);
+}
+
+MultiIndexHashing::MultiIndexHashing(const cv::Mat& descriptors_)
+: descriptors(descriptors_)
+, substrings(descriptors_.cols * 8 / SubstringBits)
+, bucketBits(MinBucketBits)
+{
+    CV_Assert(supports(descriptors));
+
+    const int count = descriptors.rows;
+
+    // About one row per bucket, so that the tables of all substrings stay in cache
+    while (bucketBits < SubstringBits && (1 << bucketBits) < count)
+        bucketBits++;
+
+    const int buckets = 1 << bucketBits;
+
+    offsets.assign(static_cast<size_t>(substrings) * (buckets + 1), 0);
+    rows.resize(static_cast<size_t>(substrings) * count);
+
+    // Counting sort of the rows by bucket, so that every bucket lists its rows in increasing order
+    std::vector<int> bucketOfRow(count);
+
+    for (int k = 0; k < substrings; k++)
+    {
+        int* table     = &offsets[static_cast<size_t>(k) * (buckets + 1)];
+        int* tableRows = count > 0 ? &rows[static_cast<size_t>(k) * count] : 0;
+
+        for (int r = 0; r < count; r++)
+        {
+            bucketOfRow[r] = bucketOf(substring(descriptors.ptr(r), k), bucketBits);
+            table[bucketOfRow[r] + 1]++;
+        }
+
+        for (int b = 0; b < buckets; b++)
+            table[b + 1] += table[b];
+
+        for (int r = 0; r < count; r++)
+            tableRows[table[bucketOfRow[r]]++] = r;
+
+        // The placement advanced every start to the end of its bucket
+        for (int b = buckets; b > 0; b--)
+            table[b] = table[b - 1];
+        table[0] = 0;
+    }
+}
+
+int MultiIndexHashing::linearNearest(const uchar* descriptor, int& distance, Scratch& scratch) const
+{
+    scratch.distances.resize(descriptors.rows);
+    HammingMatcher::distances(descriptor, descriptors, 0, descriptors.rows, &scratch.distances[0]);
+
+    int bestRow = -1;
+    distance = INT_MAX;
+
+    for (int r = 0; r < descriptors.rows; r++)
+    {
+        if (scratch.distances[r] < distance)
+        {
+            distance = scratch.distances[r];
+            bestRow  = r;
+        }
+    }
+
+    return bestRow;
+}
+
+int MultiIndexHashing::nearest(const uchar* descriptor, int& distance, Scratch& scratch) const
+{
+    distance = INT_MAX;
+    if (descriptors.rows == 0)
+        return -1;
+
+    int row;
+    if (!probe(descriptor, row, distance, 0, scratch))
+        return linearNearest(descriptor, distance, scratch);
+
+    return row;
+}
+
+bool MultiIndexHashing::probe(const uchar* descriptor, int& bestRow, int& distance, int* secondDistance, Scratch& scratch) const
+{
+    const int count = descriptors.rows;
+
+    if (scratch.seen.size() != static_cast<size_t>(count) || ++scratch.stamp == 0)
+    {
+        scratch.seen.assign(count, 0);
+        scratch.stamp = 1;
+    }
+
+    const MasksByWeight& masks = masksByWeight();
+
+    long probes = 0;
+
+    bestRow  = -1;
+    distance = INT_MAX;
+    if (secondDistance)
+        *secondDistance = INT_MAX;
+
+    for (int radius = 0; radius <= SubstringBits; radius++)
+    {
+        const uint16_t* radiusMasks = &masks.masks[masks.begin[radius]];
+        const int       maskCount   = masks.begin[radius + 1] - masks.begin[radius];
+
+        // Probing costs a bucket lookup per mask and substring; beyond the size of the index a scan is cheaper
+        if (radius > 0 && (probes + static_cast<long>(maskCount) * substrings) * ProbeCost > count)
+            return false;
+
+        for (int k = 0; k < substrings; k++)
+        {
+            const int*     table     = &offsets[static_cast<size_t>(k) * ((1 << bucketBits) + 1)];
+            const int*     tableRows = &rows[static_cast<size_t>(k) * count];
+            const uint16_t key       = substring(descriptor, k);
+
+            for (int m = 0; m < maskCount; m++)
+            {
+                const int bucket = bucketOf(key ^ radiusMasks[m], bucketBits);
+
+                for (int p = table[bucket]; p < table[bucket + 1]; p++)
+                {
+                    const int r = tableRows[p];
+                    if (scratch.seen[r] == scratch.stamp)
+                        continue;
+
+                    scratch.seen[r] = scratch.stamp;
+
+                    int d;
+                    HammingMatcher::distances(descriptor, descriptors, r, 1, &d);
+
+                    if (d < distance || (d == distance && r < bestRow))
+                    {
+                        if (secondDistance)
+                            *secondDistance = distance;
+
+                        distance = d;
+                        bestRow  = r;
+                    }
+                    else if (secondDistance && d < *secondDistance)
+                    {
+                        *secondDistance = d;
+                    }
+                }
+            }
+
+            probes += maskCount;
+
+            // A row not seen yet differs in more than radius bits in substrings 0..k and in at least
+            // radius bits in the others, so it is at least radius * substrings + k + 1 bits away.
+            if ((secondDistance ? *secondDistance : distance) <= radius * substrings + k)
+                return true;
+        }
+    }
+
+    return true;
+}
+
+void MultiIndexHashing::crossCheckMatch(const cv::Mat& query, const cv::Mat& train, std::vector<cv::DMatch>& matches)
+{
+    matches.clear();
+
+    if (query.empty() || train.empty())
+        return;
+
+    CV_Assert(supports(query) && train.type() == query.type() && train.cols == query.cols);
+
+    if (!indexPays(query))
+    {
+        HammingMatcher::crossCheckMatch(query, train, matches);
+        return;
+    }
+
+    // Every train descriptor picks its nearest query descriptor, so the query descriptors are indexed
+    const MultiIndexHashing index(query);
+    Scratch scratch;
+
+    std::vector<int> nearestQuery(train.rows, -1);
+    std::vector<int> nearestQueryDistance(train.rows, INT_MAX);
+
+    // Descriptors without a close match are collected and scanned together, tile by tile
+    std::vector<int> unresolved;
+
+    for (int j = 0; j < train.rows; j++)
+    {
+        if (!index.probe(train.ptr(j), nearestQuery[j], nearestQueryDistance[j], 0, scratch))
+            unresolved.push_back(j);
+    }
+
+    if (!unresolved.empty())
+    {
+        const cv::Mat unresolvedTrain = gatherRows(train, unresolved);
+
+        std::vector<int> scannedQuery(unresolved.size()), scannedDistance(unresolved.size());
+        HammingMatcher::nearestRows(unresolvedTrain, query, &scannedQuery[0], &scannedDistance[0]);
+
+        for (size_t u = 0; u < unresolved.size(); u++)
+        {
+            nearestQuery[unresolved[u]]         = scannedQuery[u];
+            nearestQueryDistance[unresolved[u]] = scannedDistance[u];
+        }
+    }
+
+    // Every query descriptor keeps the nearest train descriptor among those that picked it
+    std::vector<int> matchedTrain(query.rows, -1);
+    std::vector<int> matchedDistance(query.rows, INT_MAX);
+
+    for (int j = 0; j < train.rows; j++)
+    {
+        const int i = nearestQuery[j];
+        if (i >= 0 && nearestQueryDistance[j] < matchedDistance[i])
+        {
+            matchedDistance[i] = nearestQueryDistance[j];
+            matchedTrain[i]    = j;
+        }
+    }
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        if (matchedTrain[i] >= 0)
+            matches.push_back(cv::DMatch(i, matchedTrain[i], static_cast<float>(matchedDistance[i])));
+    }
+}
+
+void MultiIndexHashing::ratioMatch(const cv::Mat& query, float maxRatio, std::vector<cv::DMatch>& matches) const
+{
+    matches.clear();
+
+    if (query.empty() || descriptors.empty())
+        return;
+
+    CV_Assert(query.type() == descriptors.type() && query.cols == descriptors.cols);
+
+    Scratch scratch;
+
+    std::vector<int> nearest(query.rows), distance(query.rows), secondDistance(query.rows);
+
+    // Descriptors without two close rows are collected and scanned together, tile by tile
+    std::vector<int> unresolved;
+
+    for (int i = 0; i < query.rows; i++)
+    {
+        if (!probe(query.ptr(i), nearest[i], distance[i], &secondDistance[i], scratch))
+            unresolved.push_back(i);
+    }
+
+    if (!unresolved.empty())
+    {
+        const cv::Mat unresolvedQuery = gatherRows(query, unresolved);
+
+        std::vector<int> scannedNearest(unresolved.size()), scannedDistance(unresolved.size()), scannedSecond(unresolved.size());
+        HammingMatcher::nearestTwoRows(unresolvedQuery, descriptors, &scannedNearest[0], &scannedDistance[0], &scannedSecond[0]);
+
+        for (size_t u = 0; u < unresolved.size(); u++)
+        {
+            nearest[unresolved[u]]        = scannedNearest[u];
+            distance[unresolved[u]]       = scannedDistance[u];
+            secondDistance[unresolved[u]] = scannedSecond[u];
+        }
+    }
+
+    for (int i = 0; i < query.rows; i++)
+        HammingMatcher::ratioTest(i, nearest[i], distance[i], secondDistance[i], maxRatio, matches);
+}
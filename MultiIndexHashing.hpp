@@ -0,0 +1,72 @@
+#ifndef MultiIndexHashing_hpp
+#define MultiIndexHashing_hpp
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+//! Exact nearest neighbour index for binary descriptors (Norouzi et al., multi-index hashing).
+//! Every descriptor is split into 16 bit substrings, and each substring position gets a hash table
+//! from substring value to the rows that have it. A descriptor within Hamming distance r of the
+//! searched one matches at least one of its m substrings within distance r / m, so probing the
+//! tables at growing substring radius finds the nearest row without comparing against all of them.
+//! The hash tables have about as many buckets as rows. When the probes would cost more than a linear
+//! scan the search switches to one, so results are always exact and identical to brute force.
+class MultiIndexHashing
+{
+public:
+    static const int SubstringBits = 16;
+
+    //! Scratch space of nearest(); one per thread.
+    struct Scratch
+    {
+        Scratch();
+
+        std::vector<unsigned> seen;
+        unsigned              stamp;
+        std::vector<int>      distances;
+    };
+
+    //! True for CV_8U descriptors whose size is a multiple of the substring size (e.g. 256 and 512 bit).
+    static bool supports(const cv::Mat& descriptors);
+
+    //! True if there are enough descriptors for searching an index over them to beat a linear scan.
+    //! crossCheckMatch scans linearly otherwise.
+    static bool indexPays(const cv::Mat& descriptors);
+
+    //! Indexes the rows of descriptors, which must not change while the index is in use.
+    explicit MultiIndexHashing(const cv::Mat& descriptors);
+
+    //! Row nearest to descriptor; ties go to the lower row. Returns -1 if no rows are indexed.
+    int nearest(const uchar* descriptor, int& distance, Scratch& scratch) const;
+
+    //! Cross-checked matches of query against train, identical to those of cv::BFMatcher(NORM_HAMMING, true).
+    static void crossCheckMatch(const cv::Mat& query, const cv::Mat& train, std::vector<cv::DMatch>& matches);
+
+    //! Nearest indexed row of every query descriptor that passes the ratio test, identical to
+    //! HammingMatcher::ratioMatch against the indexed rows. The index is searched for the two nearest rows.
+    void ratioMatch(const cv::Mat& query, float maxRatio, std::vector<cv::DMatch>& matches) const;
+
+private:
+    //! Nearest row found by probing the tables, and the distance of the second nearest if secondDistance
+    //! is given. Returns false, leaving the search unfinished, as soon as probing further would cost more
+    //! than a linear scan.
+    bool probe(const uchar* descriptor, int& row, int& distance, int* secondDistance, Scratch& scratch) const;
+
+    int linearNearest(const uchar* descriptor, int& distance, Scratch& scratch) const;
+
+    //! Fewest buckets per substring position.
+    static const int MinBucketBits = 4;
+
+    cv::Mat          descriptors;
+    int              substrings;
+
+    //! Buckets per substring position are 1 << bucketBits, about as many as rows.
+    int              bucketBits;
+
+    //! Per substring position, offsets into rows for every bucket (compressed sparse rows).
+    std::vector<int> offsets;
+    std::vector<int> rows;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "PackedDataset.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace fs = boost::filesystem;
+namespace ipc = boost::interprocess;
+
+namespace
+{
+    const char     PackMagic[8] = { 'E', 'F', 'P', 'A', 'C', 'K', 'E', 'D' };
+    const uint32_t PackVersion  = 1;
+
+    // Rows of every image start at this boundary, like the buffers cv::Mat allocates
+    const uint64_t ImageAlignment = 64;
+
+    struct PackHeader
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t imageCount;
+        uint64_t indexOffset;
+    };
+
+    // Followed by nameLength bytes of the name
+    struct IndexRecord
+    {
+        uint64_t offset;
+        int32_t  rows;
+        int32_t  cols;
+        uint32_t nameLength;
+        uint32_t reserved;
+    };
+}
+
+PackedDataset::PackedDataset()
+{
+}
+
+cv::Mat PackedDataset::decodeGrayscale(const std::string& path)
+{
+    cv::Mat fullImage, image;
+    try
+    {
+        fullImage = cv::imread(path);
+    }
+    catch (const cv::Exception&)
+    {
+        fullImage.release();
+    }
+
+    if (fullImage.channels() == 3)
+    {
+        cv::cvtColor(fullImage, image, cv::COLOR_BGR2GRAY);
+    }
+    else if (fullImage.channels() == 4)
+    {
+        cv::cvtColor(fullImage, image, cv::COLOR_BGRA2GRAY);
+    }
+    else if (fullImage.channels() == 1)
+    {
+        image = fullImage;
+    }
+
+    return image;
+}
+
+bool PackedDataset::pack(const fs::path& srcDir, const std::string& path, size_t& packedImages)
+{
+    packedImages = 0;
+
+    std::vector<fs::path> files;
+    try
+    {
+        for (fs::directory_iterator it(srcDir), eod; it != eod; ++it)
+        {
+            const std::string name = it->path().filename().string();
+            if (fs::is_regular_file(it->path()) && name[0] != '.')
+                files.push_back(it->path());
+        }
+    }
+    catch (const fs::filesystem_error& e)
+    {
+        std::cout << "Cannot list " << srcDir.string() << ": " << e.what() << std::endl;
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    const std::string tempPath = path + ".tmp";
+    std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+
+    PackHeader header;
+    std::memcpy(header.magic, PackMagic, sizeof(PackMagic));
+    header.version     = PackVersion;
+    header.imageCount  = 0;
+    header.indexOffset = 0;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<IndexRecord> records;
+    std::vector<std::string> names;
+    uint64_t written = sizeof(header);
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const cv::Mat image = decodeGrayscale(files[i].string());
+        if (image.empty())
+        {
+            std::cout << "Skipped " << files[i].filename().string() << ", it cannot be decoded" << std::endl;
+            continue;
+        }
+
+        const char padding[ImageAlignment] = { 0 };
+        const uint64_t offset = (written + ImageAlignment - 1) & ~(ImageAlignment - 1);
+        out.write(padding, offset - written);
+
+        for (int y = 0; y < image.rows; y++)
+            out.write(reinterpret_cast<const char*>(image.ptr(y)), image.cols);
+
+        written = offset + image.total();
+
+        IndexRecord record = { offset, image.rows, image.cols, 0, 0 };
+        names.push_back(files[i].filename().string());
+        record.nameLength = names.back().size();
+        records.push_back(record);
+    }
+
+    header.imageCount  = records.size();
+    header.indexOffset = written;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        out.write(reinterpret_cast<const char*>(&records[i]), sizeof(IndexRecord));
+        out.write(names[i].data(), names[i].size());
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+
+    try
+    {
+        if (!out)
+        {
+            fs::remove(tempPath);
+            return false;
+        }
+
+        fs::rename(tempPath, path);
+    }
+    catch (const fs::filesystem_error& e)
+    {
+        std::cout << "Cannot write packed dataset " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    packedImages = records.size();
+    return true;
+}
+
+bool PackedDataset::open(const std::string& path)
+{
+    m_entries.clear();
+
+    try
+    {
+        ipc::file_mapping  file(path.c_str(), ipc::read_only);
+        ipc::mapped_region region(file, ipc::copy_on_write);
+
+        const unsigned char* data = static_cast<const unsigned char*>(region.get_address());
+        const size_t size = region.get_size();
+
+        if (size < sizeof(PackHeader))
+            return false;
+
+        PackHeader header;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, PackMagic, sizeof(PackMagic)) != 0 || header.version != PackVersion ||
+            header.indexOffset > size)
+            return false;
+
+        // Every image has an index record, so a count the index cannot hold is corrupt
+        if (header.imageCount > (size - header.indexOffset) / sizeof(IndexRecord))
+            return false;
+
+        std::vector<Entry> entries(header.imageCount);
+        uint64_t position = header.indexOffset;
+
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            IndexRecord record;
+            if (sizeof(record) > size - position)
+                return false;
+
+            std::memcpy(&record, data + position, sizeof(record));
+            position += sizeof(record);
+
+            if (record.nameLength > size - position || record.rows < 0 || record.cols < 0 || record.offset > size ||
+                static_cast<uint64_t>(record.rows) * record.cols > size - record.offset)
+                return false;
+
+            entries[i].name   = std::string(reinterpret_cast<const char*>(data + position), record.nameLength);
+            entries[i].offset = record.offset;
+            entries[i].rows   = record.rows;
+            entries[i].cols   = record.cols;
+            position += record.nameLength;
+        }
+
+        // The mapping stays valid after the file mapping object is gone
+        m_region.swap(region);
+        m_entries.swap(entries);
+        return true;
+    }
+    catch (const ipc::interprocess_exception&)
+    {
+        return false;
+    }
+}
+
+size_t PackedDataset::size() const
+{
+    return m_entries.size();
+}
+
+const std::string& PackedDataset::name(size_t index) const
+{
+    return m_entries[index].name;
+}
+
+cv::Mat PackedDataset::image(size_t index) const
+{
+    const Entry& entry = m_entries[index];
+    return cv::Mat(entry.rows, entry.cols, CV_8U, static_cast<unsigned char*>(m_region.get_address()) + entry.offset);
+}
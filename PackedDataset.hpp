@@ -0,0 +1,51 @@
+#ifndef PackedDataset_hpp
+#define PackedDataset_hpp
+
+#include <opencv2/opencv.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <string>
+#include <vector>
+
+//! Pre-decoded 8 bit grayscale images of a dataset in a single file: a header, the pixels of every image
+//! starting at a 64 byte boundary, and an index of their names, sizes and offsets at the end. The file is
+//! memory mapped, so images are handed out as views of the mapping without decoding or copying them.
+class PackedDataset
+{
+public:
+    PackedDataset();
+
+    //! Maps a packed dataset. Returns false if the file cannot be read or is not a packed dataset.
+    bool open(const std::string& path);
+
+    //! Decodes all visible regular files of srcDir that are images and packs them into path, in order of
+    //! their names. The file is written to a temporary name first and then renamed.
+    static bool pack(const boost::filesystem::path& srcDir, const std::string& path, size_t& packedImages);
+
+    //! Decodes an image file to 8 bit grayscale, the way every source image is read. Empty if it cannot be decoded.
+    static cv::Mat decodeGrayscale(const std::string& path);
+
+    size_t size() const;
+    const std::string& name(size_t index) const;
+
+    //! View of the pixels in the mapping, valid as long as the dataset. The mapping is copy on write,
+    //! so writing to the view changes neither the file nor other views.
+    cv::Mat image(size_t index) const;
+
+private:
+    PackedDataset(const PackedDataset&);
+    PackedDataset& operator=(const PackedDataset&);
+
+    struct Entry
+    {
+        std::string name;
+        uint64_t    offset;
+        int         rows;
+        int         cols;
+    };
+
+    boost::interprocess::mapped_region m_region;
+    std::vector<Entry>                 m_entries;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "PerfCounters.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#pragma mark - PerfCounts implementation
+
+PerfCounts::PerfCounts()
+: descriptors(0)
+{
+    for (int i = 0; i < PerfEventCount; i++)
+        events[i] = 0;
+}
+
+void PerfCounts::merge(const PerfCounts& other)
+{
+    descriptors += other.descriptors;
+    for (int i = 0; i < PerfEventCount; i++)
+        events[i] += other.events[i];
+}
+
+bool PerfCounts::tryGetPerDescriptor(PerfEvent event, float& value) const
+{
+    if (descriptors == 0)
+        return false;
+
+    value = static_cast<float>(static_cast<double>(events[event]) / descriptors);
+    return true;
+}
+
+#pragma mark - PerfCounters implementation
+
+static bool countersEnabled = false;
+
+void PerfCounters::setEnabled(bool enabled)
+{
+    countersEnabled = enabled;
+}
+
+bool PerfCounters::isEnabled()
+{
+    return countersEnabled;
+}
+
+PerfCounters& PerfCounters::local()
+{
+    static thread_local PerfCounters counters;
+    return counters;
+}
+
+#if defined(__linux__)
+
+static std::atomic<bool> unavailableReported(false);
+
+static int openCounter(uint64_t config, int groupFd)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    // Calling thread only, on whatever CPU it runs
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+
+PerfCounters::PerfCounters()
+: m_available(false)
+{
+    for (int i = 0; i < PerfEventCount; i++)
+        m_fds[i] = -1;
+
+    if (!countersEnabled)
+        return;
+
+    const uint64_t configs[PerfEventCount] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    // One group, so that all events are scheduled onto the PMU together
+    for (int i = 0; i < PerfEventCount; i++)
+    {
+        m_fds[i] = openCounter(configs[i], i == 0 ? -1 : m_fds[0]);
+        if (m_fds[i] < 0)
+        {
+            if (!unavailableReported.exchange(true))
+                std::cout << "Hardware performance counters are not available: " << std::strerror(errno) << std::endl;
+
+            for (int j = 0; j < i; j++)
+            {
+                close(m_fds[j]);
+                m_fds[j] = -1;
+            }
+            return;
+        }
+    }
+
+    m_available = true;
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int i = PerfEventCount - 1; i >= 0; i--)
+    {
+        if (m_fds[i] >= 0)
+            close(m_fds[i]);
+    }
+}
+
+bool PerfCounters::read(PerfReading& reading) const
+{
+    if (!m_available)
+        return false;
+
+    // nr, time enabled, time running, then one value per event
+    uint64_t data[3 + PerfEventCount];
+    if (::read(m_fds[0], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[0] != PerfEventCount)
+        return false;
+
+    reading.enabled = data[1];
+    reading.running = data[2];
+    for (int i = 0; i < PerfEventCount; i++)
+        reading.values[i] = data[3 + i];
+
+    return true;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+: m_available(false)
+{
+    for (int i = 0; i < PerfEventCount; i++)
+        m_fds[i] = -1;
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+bool PerfCounters::read(PerfReading& reading) const
+{
+    return false;
+}
+
+#endif
+
+bool PerfCounters::isAvailable() const
+{
+    return m_available;
+}
+
+#pragma mark - PerfSection implementation
+
+PerfSection::PerfSection()
+: m_started(countersEnabled && PerfCounters::local().read(m_start))
+{
+}
+
+void PerfSection::stop(PerfCounts& counts, uint64_t descriptors)
+{
+    PerfReading end;
+    if (!m_started || !PerfCounters::local().read(end))
+        return;
+
+    m_started = false;
+
+    // The counters, enabled and running times are monotonic, so the deltas cannot be negative
+    const uint64_t enabled = end.enabled - m_start.enabled;
+    const uint64_t running = end.running - m_start.running;
+    if (running == 0)
+        return;
+
+    counts.descriptors += descriptors;
+    for (int i = 0; i < PerfEventCount; i++)
+    {
+        const uint64_t delta = end.values[i] - m_start.values[i];
+        counts.events[i] += running < enabled ? static_cast<uint64_t>(static_cast<double>(delta) * enabled / running) : delta;
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef PerfCounters_hpp
+#define PerfCounters_hpp
+
+#include <cstdint>
+
+//! Hardware events counted around descriptor extraction and matching.
+typedef enum
+{
+    PerfEventCycles,
+    PerfEventInstructions,
+    PerfEventCacheMisses,
+    PerfEventBranchMisses,
+    PerfEventCount
+} PerfEvent;
+
+//! Hardware event totals over a number of descriptors.
+struct PerfCounts
+{
+    PerfCounts();
+
+    //! Number of descriptors the events were counted for; zero if no counters were available.
+    uint64_t descriptors;
+    uint64_t events[PerfEventCount];
+
+    void merge(const PerfCounts& other);
+
+    //! Average number of the event per descriptor. Returns false if nothing was counted.
+    bool tryGetPerDescriptor(PerfEvent event, float& value) const;
+};
+
+//! Raw group read of the counters. The kernel multiplexes the group when there are more events than PMU
+//! counters; the values only advance while the group is running.
+struct PerfReading
+{
+    uint64_t enabled;
+    uint64_t running;
+    uint64_t values[PerfEventCount];
+};
+
+//! Hardware counters of the calling thread, read through perf_event_open on Linux. Counting is
+//! off unless enabled; when the counters cannot be opened (other platforms, a restrictive
+//! perf_event_paranoid, virtual machines without a PMU) sections simply report nothing.
+class PerfCounters
+{
+public:
+    //! Must be called before the first section is measured.
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    //! Counters of the calling thread, opened on first use.
+    static PerfCounters& local();
+
+    ~PerfCounters();
+
+    bool isAvailable() const;
+
+    //! Current raw counter values with the times the group was enabled and running.
+    bool read(PerfReading& reading) const;
+
+private:
+    PerfCounters();
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    int m_fds[PerfEventCount];
+    bool m_available;
+};
+
+//! Counts the events of the calling thread from construction until stop().
+class PerfSection
+{
+public:
+    PerfSection();
+
+    //! Adds the events since construction to counts, attributed to the given number of descriptors. The deltas
+    //! are scaled by the share of the section the group was running, if the kernel multiplexed it; a section
+    //! during which the group never ran counts nothing.
+    void stop(PerfCounts& counts, uint64_t descriptors);
+
+private:
+    bool        m_started;
+    PerfReading m_start;
+};
+
+#endif
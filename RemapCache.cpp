@@ -0,0 +1,177 @@
+#include "RemapCache.hpp"
+
+#include <algorithm>
+#include <climits>
+
+static const size_t DefaultCapacity = size_t(256) << 20;
+
+// Coordinate maps in the format cv::warpPerspective computes internally, from the same double precision
+// arithmetic, so that remapping with them gives the same pixels as the warp.
+static void buildMaps(const cv::Matx33d& homography, const cv::Size& size, int interpolation, cv::Mat& map1, cv::Mat& map2)
+{
+    const cv::Matx33d M = homography.inv();
+
+    const bool   nearest = interpolation == cv::INTER_NEAREST;
+    const int    bits    = nearest ? 0 : cv::INTER_BITS;
+    const double scale   = nearest ? 1 : cv::INTER_TAB_SIZE;
+    const int    mask    = cv::INTER_TAB_SIZE - 1;
+
+    map1.create(size, CV_16SC2);
+    if (nearest)
+        map2.release();
+    else
+        map2.create(size, CV_16UC1);
+
+    for (int y = 0; y < size.height; y++)
+    {
+        short*  xy    = map1.ptr<short>(y);
+        ushort* alpha = nearest ? 0 : map2.ptr<ushort>(y);
+
+        const double X0 = M(0, 1) * y + M(0, 2);
+        const double Y0 = M(1, 1) * y + M(1, 2);
+        const double W0 = M(2, 1) * y + M(2, 2);
+
+        for (int x = 0; x < size.width; x++)
+        {
+            double W = W0 + M(2, 0) * x;
+            W = W ? scale / W : 0;
+
+            const double fX = std::max(static_cast<double>(INT_MIN), std::min(static_cast<double>(INT_MAX), (X0 + M(0, 0) * x) * W));
+            const double fY = std::max(static_cast<double>(INT_MIN), std::min(static_cast<double>(INT_MAX), (Y0 + M(1, 0) * x) * W));
+            const int    X  = cv::saturate_cast<int>(fX);
+            const int    Y  = cv::saturate_cast<int>(fY);
+
+            xy[x * 2]     = cv::saturate_cast<short>(X >> bits);
+            xy[x * 2 + 1] = cv::saturate_cast<short>(Y >> bits);
+
+            if (alpha)
+                alpha[x] = static_cast<ushort>((Y & mask) * cv::INTER_TAB_SIZE + (X & mask));
+        }
+    }
+}
+
+#pragma mark - RemapCache implementation
+
+RemapCache::RemapCache()
+: m_capacity(DefaultCapacity)
+, m_bytes(0)
+, m_hits(0)
+, m_misses(0)
+, m_evictions(0)
+{
+}
+
+RemapCache& RemapCache::instance()
+{
+    static RemapCache cache;
+    return cache;
+}
+
+void RemapCache::warp(const void* owner, float argument, const cv::Mat& source, cv::Mat& result,
+                      const cv::Matx33d& homography, const cv::Size& size, int interpolation)
+{
+    // Maps that would be dropped right away only add work to the warp, and lookups of a disabled
+    // cache are not counted
+    if (!isEnabled())
+    {
+        cv::warpPerspective(source, result, homography, size, interpolation, cv::BORDER_CONSTANT);
+        return;
+    }
+
+    const Key key(owner, argument, source.cols, source.rows, interpolation);
+
+    cv::Mat map1, map2;
+    if (!lookup(key, map1, map2))
+    {
+        // Built outside of the lock, so that warps of other frames are not held up
+        buildMaps(homography, size, interpolation, map1, map2);
+        insert(key, map1, map2);
+    }
+
+    cv::remap(source, result, map1, map2, interpolation, cv::BORDER_CONSTANT);
+}
+
+bool RemapCache::isEnabled() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_capacity > 0;
+}
+
+bool RemapCache::lookup(const Key& key, cv::Mat& map1, cv::Mat& map2)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    std::map<Key, EntryList::iterator>::iterator it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+
+    // The maps are reference counted, so they stay valid for the caller even if evicted meanwhile
+    map1 = it->second->map1;
+    map2 = it->second->map2;
+    return true;
+}
+
+void RemapCache::insert(const Key& key, const cv::Mat& map1, const cv::Mat& map2)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // Another thread may have built the same maps meanwhile
+    if (m_capacity == 0 || m_index.count(key))
+        return;
+
+    Entry entry;
+    entry.key   = key;
+    entry.map1  = map1;
+    entry.map2  = map2;
+    entry.bytes = map1.total() * map1.elemSize() + map2.total() * map2.elemSize();
+
+    m_entries.push_front(entry);
+    m_index[key] = m_entries.begin();
+    m_bytes += entry.bytes;
+
+    evict();
+}
+
+void RemapCache::evict()
+{
+    while (m_bytes > m_capacity && !m_entries.empty())
+    {
+        const Entry& oldest = m_entries.back();
+
+        m_bytes -= oldest.bytes;
+        m_index.erase(oldest.key);
+        m_entries.pop_back();
+        m_evictions++;
+    }
+}
+
+void RemapCache::setCapacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_capacity = bytes;
+    evict();
+}
+
+std::ostream& RemapCache::printStatistics(std::ostream& str) const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    const uint64 lookups = m_hits + m_misses;
+
+    str << "Hits\tMisses\tHitRate\tEvictions\tEntries\tMegabytes" << std::endl;
+    str << m_hits << "\t"
+        << m_misses << "\t"
+        << (lookups > 0 ? m_hits / static_cast<double>(lookups) : 0) << "\t"
+        << m_evictions << "\t"
+        << m_entries.size() << "\t"
+        << m_bytes / double(1 << 20) << std::endl;
+
+    return str;
+}
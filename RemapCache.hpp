@@ -0,0 +1,67 @@
+#ifndef RemapCache_hpp
+#define RemapCache_hpp
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+//! Process-wide least recently used cache of the fixed-point coordinate maps of warps. The images of a
+//! dataset come in a handful of sizes, so the maps of a (transformation, argument, image size, interpolation)
+//! are computed on the first warp and every later warp of an image of that size is a plain cv::remap.
+class RemapCache
+{
+public:
+    static RemapCache& instance();
+
+    //! Same as cv::warpPerspective(source, result, homography, size, interpolation) with a constant black border.
+    //! owner and argument identify the homography and the size of the result for images of the source size.
+    void warp(const void* owner, float argument, const cv::Mat& source, cv::Mat& result,
+              const cv::Matx33d& homography, const cv::Size& size, int interpolation);
+
+    //! Upper bound of the memory held by the maps; least recently used maps are evicted beyond it.
+    //! 0 disables the cache.
+    void setCapacity(size_t bytes);
+
+    std::ostream& printStatistics(std::ostream& str) const;
+
+private:
+    RemapCache();
+    RemapCache(const RemapCache&);
+    RemapCache& operator=(const RemapCache&);
+
+    //! (owner, argument, source width, source height, interpolation)
+    typedef std::tuple<const void*, float, int, int, int> Key;
+
+    struct Entry
+    {
+        Key     key;
+        cv::Mat map1;
+        cv::Mat map2;
+        size_t  bytes;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    bool isEnabled() const;
+    bool lookup(const Key& key, cv::Mat& map1, cv::Mat& map2);
+    void insert(const Key& key, const cv::Mat& map1, const cv::Mat& map2);
+    void evict();
+
+    mutable std::mutex                 m_lock;
+
+    //! Most recently used first
+    EntryList                          m_entries;
+    std::map<Key, EntryList::iterator> m_index;
+
+    size_t                             m_capacity;
+    size_t                             m_bytes;
+
+    uint64                             m_hits;
+    uint64                             m_misses;
+    uint64                             m_evictions;
+};
+
+#endif
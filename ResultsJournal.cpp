@@ -0,0 +1,294 @@
+#include "ResultsJournal.hpp"
+
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <cstring>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+    const char JournalMagic[8] = { 'E', 'F', 'J', 'R', 'N', 'L', '0', '6' };
+
+    enum RecordType
+    {
+        NameRecord   = 'N',
+        FrameRecord  = 'F',
+        CommitRecord = 'C'
+    };
+
+    template<typename T>
+    void put(std::ostream& out, T value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    bool get(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    void putAllocations(std::ostream& out, const AllocationCounts& allocations)
+    {
+        put<uint64_t>(out, allocations.bytes);
+        put<uint64_t>(out, allocations.allocations);
+        put<uint64_t>(out, allocations.peakBytes);
+    }
+
+    bool getAllocations(std::istream& in, AllocationCounts& allocations)
+    {
+        return get(in, allocations.bytes) && get(in, allocations.allocations) && get(in, allocations.peakBytes);
+    }
+
+    void putCounts(std::ostream& out, const PerfCounts& counts)
+    {
+        put<uint64_t>(out, counts.descriptors);
+        for (int i = 0; i < PerfEventCount; i++)
+            put<uint64_t>(out, counts.events[i]);
+    }
+
+    bool getCounts(std::istream& in, PerfCounts& counts)
+    {
+        bool ok = get(in, counts.descriptors);
+        for (int i = 0; i < PerfEventCount; i++)
+            ok = ok && get(in, counts.events[i]);
+        return ok;
+    }
+}
+
+ResultsJournal::ResultsJournal(const std::string& path)
+: m_path(path)
+, m_restored(false)
+, m_pending(16)
+{
+}
+
+ResultsJournal::~ResultsJournal()
+{
+    close();
+}
+
+void ResultsJournal::restore(CollectedStatistics& stats, std::set<std::string>& completedImages)
+{
+    m_restored = true;
+
+    std::ifstream in(m_path.c_str(), std::ios::binary);
+    if (!in)
+        return;
+
+    char magic[sizeof(JournalMagic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, JournalMagic, sizeof(magic)) != 0)
+    {
+        std::cout << "Journal " << m_path << " has an unknown format and is started over" << std::endl;
+        in.close();
+        rotate();
+        return;
+    }
+
+    std::vector<std::string> names;
+    size_t committedNames = 0;
+    std::streamoff committedSize = in.tellg();
+
+    CollectedStatistics pending;
+    uint8_t type;
+
+    // Stops at the first record that was cut off by the crash
+    while (get(in, type))
+    {
+        if (type == NameRecord)
+        {
+            uint32_t id, length;
+            if (!get(in, id) || !get(in, length) || id != names.size())
+                break;
+
+            std::string name(length, '\0');
+            if (length > 0 && !in.read(&name[0], length))
+                break;
+
+            names.push_back(name);
+        }
+        else if (type == FrameRecord)
+        {
+            uint32_t algId, transId, index;
+            uint8_t  isValid;
+            float    argumentValue, consumedTimeMs, precision, recall, repeatability, matchingScore;
+            int32_t  totalKeypoints, measuredKeypoints;
+            uint32_t imageId;
+            AllocationCounts describeAllocations, matchAllocations;
+            PerfCounts describeCounters, matchCounters;
+
+            if (!get(in, imageId) || !get(in, algId) || !get(in, transId) || !get(in, index) ||
+                !get(in, isValid) || !get(in, argumentValue) || !get(in, totalKeypoints) || !get(in, measuredKeypoints) ||
+                !get(in, consumedTimeMs) || !get(in, precision) || !get(in, recall) ||
+                !get(in, repeatability) || !get(in, matchingScore) ||
+                !getAllocations(in, describeAllocations) || !getCounts(in, describeCounters) ||
+                !getAllocations(in, matchAllocations) || !getCounts(in, matchCounters))
+                break;
+
+            if (algId >= names.size() || transId >= names.size())
+                break;
+
+            FrameMatchingStatistics s;
+            s.argumentValue = argumentValue;
+
+            // Every record holds a single sample, so the accumulators are rebuilt from it
+            if (isValid)
+                s.addSample(totalKeypoints, precision, recall, repeatability, matchingScore, matchAllocations, matchCounters);
+
+            if (isValid && measuredKeypoints > 0)
+                s.addDescribeCost(measuredKeypoints, consumedTimeMs, describeAllocations, describeCounters);
+
+            pending.add(NameTable::algorithms().intern(names[algId]), NameTable::transformations().intern(names[transId]), index, s);
+        }
+        else if (type == CommitRecord)
+        {
+            uint32_t imageId;
+            if (!get(in, imageId) || imageId >= names.size())
+                break;
+
+            stats.merge(pending);
+            completedImages.insert(names[imageId]);
+            pending = CollectedStatistics();
+
+            committedNames = names.size();
+            committedSize  = in.tellg();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    in.close();
+
+    for (size_t id = 0; id < committedNames; id++)
+        m_nameIds[names[id]] = id;
+
+    // Drop everything after the last commit so that appended records follow a complete one
+    fs::resize_file(m_path, committedSize);
+}
+
+void ResultsJournal::rotate()
+{
+    if (!fs::exists(m_path) || fs::file_size(m_path) == 0)
+        return;
+
+    std::string rotated;
+    for (int n = 1; rotated.empty() || fs::exists(rotated); n++)
+        rotated = m_path + "." + std::to_string(n);
+
+    fs::rename(m_path, rotated);
+    m_nameIds.clear();
+    std::cout << "Journal " << m_path << " of an earlier run was kept as " << rotated << std::endl;
+}
+
+void ResultsJournal::append(const std::string& imageName, const CollectedStatistics& imageStats)
+{
+    if (!m_writer.joinable())
+    {
+        bool continued = m_restored && fs::exists(m_path) && fs::file_size(m_path) > 0;
+
+        m_out.open(m_path.c_str(), std::ios::binary | (continued ? std::ios::app : std::ios::trunc));
+        if (!continued)
+        {
+            m_out.write(JournalMagic, sizeof(JournalMagic));
+            m_nameIds.clear();
+        }
+
+        m_writer = std::thread(&ResultsJournal::writeImages, this);
+    }
+
+    PendingImage image;
+    image.name  = imageName;
+    image.stats = imageStats;
+    m_pending.push(std::move(image));
+}
+
+void ResultsJournal::close()
+{
+    m_pending.close();
+
+    if (m_writer.joinable())
+        m_writer.join();
+
+    if (m_out.is_open())
+        m_out.close();
+}
+
+void ResultsJournal::writeImages()
+{
+    PendingImage image;
+
+    // Keeps draining after close() until the queue is empty
+    while (m_pending.pop(image))
+    {
+        writeImage(image);
+    }
+}
+
+uint32_t ResultsJournal::nameId(const std::string& name)
+{
+    std::map<std::string, uint32_t>::const_iterator it = m_nameIds.find(name);
+    if (it != m_nameIds.end())
+        return it->second;
+
+    uint32_t id = m_nameIds.size();
+    m_nameIds[name] = id;
+
+    put<uint8_t>(m_out, NameRecord);
+    put<uint32_t>(m_out, id);
+    put<uint32_t>(m_out, name.size());
+    m_out.write(name.data(), name.size());
+
+    return id;
+}
+
+void ResultsJournal::writeImage(const PendingImage& image)
+{
+    const uint32_t imageId = nameId(image.name);
+
+    for (int a = 0; a < image.stats.algorithmCount(); a++)
+    {
+        for (int t = 0; t < image.stats.transformationCount(); t++)
+        {
+            const RunStatistics run = image.stats.run(a, t);
+            if (run.empty())
+                continue;
+
+            const uint32_t algId   = nameId(NameTable::algorithms().name(a));
+            const uint32_t transId = nameId(NameTable::transformations().name(t));
+
+            const StatisticsCells& s = *run.cells;
+
+            for (size_t index = 0; index < run.size; index++)
+            {
+                // The cells of one image hold a single sample, whose precision and recall are NaN if undefined
+                const size_t cell = run.cell(index);
+
+                put<uint8_t>(m_out, FrameRecord);
+                put<uint32_t>(m_out, imageId);
+                put<uint32_t>(m_out, algId);
+                put<uint32_t>(m_out, transId);
+                put<uint32_t>(m_out, index);
+                put<uint8_t>(m_out, s.isValid[cell] ? 1 : 0);
+                put<float>(m_out, s.argumentValue[cell]);
+                put<int32_t>(m_out, s.totalKeypoints[cell]);
+                put<int32_t>(m_out, s.measuredKeypoints[cell]);
+                put<float>(m_out, s.consumedTimeMs[cell]);
+                put<float>(m_out, s.undefinedPrecisions[cell] ? NAN : s.precision[cell]);
+                put<float>(m_out, s.undefinedRecalls[cell] ? NAN : s.recall[cell]);
+                put<float>(m_out, s.repeatability[cell]);
+                put<float>(m_out, s.matchingScore[cell]);
+                putAllocations(m_out, s.describeAllocations[cell]);
+                putCounts(m_out, s.describeCounters[cell]);
+                putAllocations(m_out, s.matchAllocations[cell]);
+                putCounts(m_out, s.matchCounters[cell]);
+            }
+        }
+    }
+
+    put<uint8_t>(m_out, CommitRecord);
+    put<uint32_t>(m_out, imageId);
+    m_out.flush();
+}
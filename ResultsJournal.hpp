@@ -0,0 +1,67 @@
+#ifndef ResultsJournal_hpp
+#define ResultsJournal_hpp
+
+#include "CollectedStatistics.hpp"
+#include "BoundedQueue.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+
+//! Append-only binary log of the per-image results of a run, written by a background thread.
+//! Every image is written as one compact record per (algorithm, transformation, argument)
+//! followed by a commit record and flushed, so that an interrupted run can be resumed from the
+//! last completed image. Names are written once and referenced by id afterwards.
+class ResultsJournal
+{
+public:
+    explicit ResultsJournal(const std::string& path);
+
+    //! Writes all queued images before returning.
+    ~ResultsJournal();
+
+    //! Merges the results of all committed images into stats and returns their names in
+    //! completedImages. Records of an image without a commit record are dropped from the journal.
+    //! Must be called before the first append; otherwise the journal is started from scratch.
+    void restore(CollectedStatistics& stats, std::set<std::string>& completedImages);
+
+    //! Renames an existing journal to the first free name of path.1, path.2, ..., so that a run that does not
+    //! resume it starts a new journal instead of overwriting the committed images of an earlier run.
+    //! Must be called before the first append.
+    void rotate();
+
+    //! Queues the results of one image to be appended and committed by the writer thread.
+    void append(const std::string& imageName, const CollectedStatistics& imageStats);
+
+    //! Blocks until all queued images have been written and stops the writer thread.
+    void close();
+
+private:
+    ResultsJournal(const ResultsJournal&);
+    ResultsJournal& operator=(const ResultsJournal&);
+
+    struct PendingImage
+    {
+        std::string         name;
+        CollectedStatistics stats;
+    };
+
+    void writeImages();
+    void writeImage(const PendingImage& image);
+    uint32_t nameId(const std::string& name);
+
+    std::string                     m_path;
+    bool                            m_restored;
+
+    // Owned by the writer thread once it has been started
+    std::ofstream                   m_out;
+    std::map<std::string, uint32_t> m_nameIds;
+
+    BoundedQueue<PendingImage>      m_pending;
+    std::thread                     m_writer;
+};
+
+#endif
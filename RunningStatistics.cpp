@@ -0,0 +1,293 @@
+#include "RunningStatistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#pragma mark - RunningStatistics implementation
+
+RunningStatistics::RunningStatistics()
+: m_count(0)
+, m_mean(0)
+, m_m2(0)
+{
+}
+
+void RunningStatistics::add(double value)
+{
+    m_count++;
+    double delta = value - m_mean;
+    m_mean += delta / m_count;
+    m_m2   += delta * (value - m_mean);
+}
+
+void RunningStatistics::merge(const RunningStatistics& other)
+{
+    if (other.m_count == 0)
+        return;
+
+    if (m_count == 0)
+    {
+        *this = other;
+        return;
+    }
+
+    const double n1    = static_cast<double>(m_count);
+    const double n2    = static_cast<double>(other.m_count);
+    const double n     = n1 + n2;
+    const double delta = other.m_mean - m_mean;
+
+    m_mean  += delta * n2 / n;
+    m_m2    += other.m_m2 + delta * delta * n1 * n2 / n;
+    m_count += other.m_count;
+}
+
+uint64_t RunningStatistics::count() const
+{
+    return m_count;
+}
+
+double RunningStatistics::mean() const
+{
+    return m_mean;
+}
+
+double RunningStatistics::variance() const
+{
+    return m_count > 1 ? m_m2 / (m_count - 1) : 0.0;
+}
+
+double RunningStatistics::stdDev() const
+{
+    return std::sqrt(variance());
+}
+
+#pragma mark - LatencyHistogram implementation
+
+// Values below SubBuckets nanoseconds are stored exactly; every further power of two is split into
+// SubBuckets / 2 linear sub-buckets.
+static const int      SubBucketBits = 6;
+static const uint64_t SubBuckets    = uint64_t(1) << SubBucketBits;
+static const uint64_t HalfBuckets   = SubBuckets / 2;
+
+static int highestBit(uint64_t value)
+{
+    int bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+}
+
+uint16_t LatencyHistogram::bucketIndex(uint64_t ns)
+{
+    if (ns < SubBuckets)
+        return static_cast<uint16_t>(ns);
+
+    const int shift    = highestBit(ns) - SubBucketBits + 1;
+    const uint64_t sub = ns >> shift;
+    return static_cast<uint16_t>(SubBuckets + (shift - 1) * HalfBuckets + (sub - HalfBuckets));
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(uint16_t index)
+{
+    if (index < SubBuckets)
+        return index;
+
+    const int shift    = static_cast<int>((index - SubBuckets) / HalfBuckets) + 1;
+    const uint64_t sub = (index - SubBuckets) % HalfBuckets + HalfBuckets;
+    return sub << shift;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(uint16_t index)
+{
+    if (index < SubBuckets)
+        return index;
+
+    const int shift = static_cast<int>((index - SubBuckets) / HalfBuckets) + 1;
+    return bucketLowerBound(index) + ((uint64_t(1) << shift) - 1);
+}
+
+LatencyHistogram::LatencyHistogram()
+: m_count(0)
+, m_min(std::numeric_limits<uint64_t>::max())
+, m_max(0)
+{
+}
+
+static bool lessIndex(const std::pair<uint16_t, uint64_t>& bucket, uint16_t index)
+{
+    return bucket.first < index;
+}
+
+void LatencyHistogram::add(double milliseconds)
+{
+    const uint64_t ns = milliseconds > 0 ? static_cast<uint64_t>(milliseconds * 1e6 + 0.5) : 0;
+    const uint16_t index = bucketIndex(ns);
+
+    std::vector< std::pair<uint16_t, uint64_t> >::iterator it =
+        std::lower_bound(m_buckets.begin(), m_buckets.end(), index, lessIndex);
+
+    if (it != m_buckets.end() && it->first == index)
+        it->second++;
+    else
+        m_buckets.insert(it, std::make_pair(index, uint64_t(1)));
+
+    m_count++;
+    m_min = std::min(m_min, ns);
+    m_max = std::max(m_max, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    if (other.m_count == 0)
+        return;
+
+    std::vector< std::pair<uint16_t, uint64_t> > merged;
+    merged.reserve(m_buckets.size() + other.m_buckets.size());
+
+    size_t i = 0, j = 0;
+    while (i < m_buckets.size() || j < other.m_buckets.size())
+    {
+        if (j == other.m_buckets.size() || (i < m_buckets.size() && m_buckets[i].first < other.m_buckets[j].first))
+        {
+            merged.push_back(m_buckets[i++]);
+        }
+        else if (i == m_buckets.size() || other.m_buckets[j].first < m_buckets[i].first)
+        {
+            merged.push_back(other.m_buckets[j++]);
+        }
+        else
+        {
+            merged.push_back(std::make_pair(m_buckets[i].first, m_buckets[i].second + other.m_buckets[j].second));
+            i++;
+            j++;
+        }
+    }
+
+    m_buckets.swap(merged);
+    m_count += other.m_count;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+double LatencyHistogram::minimum() const
+{
+    return m_count > 0 ? m_min * 1e-6 : 0.0;
+}
+
+double LatencyHistogram::maximum() const
+{
+    return m_max * 1e-6;
+}
+
+double LatencyHistogram::quantile(double q) const
+{
+    if (m_count == 0)
+        return 0.0;
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * m_count)));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m_buckets.size(); i++)
+    {
+        seen += m_buckets[i].second;
+        if (seen >= rank)
+        {
+            // Middle of the bucket, clamped to the exact extremes
+            uint64_t lower = bucketLowerBound(m_buckets[i].first);
+            uint64_t upper = bucketUpperBound(m_buckets[i].first);
+            uint64_t value = std::min(std::max(lower + (upper - lower) / 2, m_min), m_max);
+            return value * 1e-6;
+        }
+    }
+
+    return maximum();
+}
+
+std::vector< std::pair<double, uint64_t> > LatencyHistogram::buckets() const
+{
+    std::vector< std::pair<double, uint64_t> > result;
+    result.reserve(m_buckets.size());
+
+    for (size_t i = 0; i < m_buckets.size(); i++)
+        result.push_back(std::make_pair(bucketLowerBound(m_buckets[i].first) * 1e-6, m_buckets[i].second));
+
+    return result;
+}
+
+#pragma mark - BoundedLatencyHistogram implementation
+
+BoundedLatencyHistogram::BoundedLatencyHistogram()
+: m_count(0)
+, m_min(std::numeric_limits<uint64_t>::max())
+, m_max(0)
+{
+    std::fill(m_buckets, m_buckets + BucketCount, 0);
+}
+
+void BoundedLatencyHistogram::add(double milliseconds)
+{
+    const uint64_t ns = milliseconds > 0 ? static_cast<uint64_t>(milliseconds * 1e6 + 0.5) : 0;
+
+    m_buckets[LatencyHistogram::bucketIndex(ns < MaxNanoseconds ? ns : MaxNanoseconds)]++;
+    m_count++;
+    m_min = std::min(m_min, ns);
+    m_max = std::max(m_max, ns);
+}
+
+void BoundedLatencyHistogram::merge(const BoundedLatencyHistogram& other)
+{
+    if (other.m_count == 0)
+        return;
+
+    for (int i = 0; i < BucketCount; i++)
+        m_buckets[i] += other.m_buckets[i];
+
+    m_count += other.m_count;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t BoundedLatencyHistogram::count() const
+{
+    return m_count;
+}
+
+double BoundedLatencyHistogram::minimum() const
+{
+    return m_count > 0 ? m_min * 1e-6 : 0.0;
+}
+
+double BoundedLatencyHistogram::maximum() const
+{
+    return m_max * 1e-6;
+}
+
+double BoundedLatencyHistogram::quantile(double q) const
+{
+    if (m_count == 0)
+        return 0.0;
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * m_count)));
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BucketCount; i++)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+        {
+            // Middle of the bucket, clamped to the exact extremes
+            uint64_t lower = LatencyHistogram::bucketLowerBound(i);
+            uint64_t upper = LatencyHistogram::bucketUpperBound(i);
+            uint64_t value = std::min(std::max(lower + (upper - lower) / 2, m_min), m_max);
+            return value * 1e-6;
+        }
+    }
+
+    return maximum();
+}
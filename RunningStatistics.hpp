@@ -0,0 +1,98 @@
+#ifndef RunningStatistics_hpp
+#define RunningStatistics_hpp
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//! Streaming count, mean and variance (Welford's algorithm). Two instances can be merged
+//! exactly using the pairwise update of Chan et al.
+class RunningStatistics
+{
+public:
+    RunningStatistics();
+
+    void add(double value);
+    void merge(const RunningStatistics& other);
+
+    uint64_t count() const;
+    double   mean() const;
+
+    //! Sample variance; zero for less than two values.
+    double   variance() const;
+    double   stdDev() const;
+
+private:
+    uint64_t m_count;
+    double   m_mean;
+    double   m_m2;
+};
+
+//! Mergeable latency histogram in the style of HdrHistogram: power-of-two magnitudes, each split
+//! into linear sub-buckets, so quantiles have a relative error below 1/32 over the whole range
+//! from nanoseconds to hours. Only non-empty buckets are stored.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(double milliseconds);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const;
+    double   minimum() const;
+    double   maximum() const;
+
+    //! Value in milliseconds below which the fraction q of all recorded values lies.
+    double   quantile(double q) const;
+
+    //! Non-empty buckets as (lower bound in milliseconds, count) pairs, in increasing order.
+    std::vector< std::pair<double, uint64_t> > buckets() const;
+
+private:
+    friend class BoundedLatencyHistogram;
+
+    static uint16_t bucketIndex(uint64_t nanoseconds);
+    static uint64_t bucketLowerBound(uint16_t index);
+    static uint64_t bucketUpperBound(uint16_t index);
+
+    // Sorted by bucket index
+    std::vector< std::pair<uint16_t, uint64_t> > m_buckets;
+
+    uint64_t m_count;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+//! LatencyHistogram with the buckets of values up to MaxNanoseconds in a fixed-size array, so that it is
+//! copied and merged without allocating. Larger values are counted in the last bucket; the minimum and
+//! maximum stay exact, and quantiles are clamped to them.
+class BoundedLatencyHistogram
+{
+public:
+    BoundedLatencyHistogram();
+
+    void add(double milliseconds);
+    void merge(const BoundedLatencyHistogram& other);
+
+    uint64_t count() const;
+    double   minimum() const;
+    double   maximum() const;
+
+    //! Value in milliseconds below which the fraction q of all recorded values lies.
+    double   quantile(double q) const;
+
+    //! About 34 seconds
+    static const uint64_t MaxNanoseconds = (uint64_t(1) << 35) - 1;
+
+private:
+    static const int BucketCount = 1024;
+
+    uint32_t m_buckets[BucketCount];
+
+    uint64_t m_count;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+#endif
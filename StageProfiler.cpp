@@ -0,0 +1,148 @@
+#include "StageProfiler.hpp"
+#include "ThreadLocalPool.hpp"
+#include "CollectedStatistics.hpp"
+
+#include <algorithm>
+#include <vector>
+
+const char* stageName(EvaluationStage stage)
+{
+    switch (stage)
+    {
+    case StageDecode:      return "Decode";
+    case StageDetect:      return "Detect";
+    case StageWarp:        return "Warp";
+    case StageDescribe:    return "Describe";
+    case StageMatch:       return "Match";
+    case StageGroundTruth: return "GroundTruth";
+    default:               return "Unknown";
+    }
+}
+
+#pragma mark - StageLatency implementation
+
+void StageLatency::add(double milliseconds)
+{
+    stats.add(milliseconds);
+    histogram.add(milliseconds);
+}
+
+void StageLatency::merge(const StageLatency& other)
+{
+    stats.merge(other.stats);
+    histogram.merge(other.histogram);
+}
+
+#pragma mark - StageProfiler implementation
+
+StageProfiler::StageProfiler()
+{
+}
+
+StageProfiler& StageProfiler::instance()
+{
+    static StageProfiler profiler;
+    return profiler;
+}
+
+void StageProfiler::record(EvaluationStage stage, int algorithmId, int transformationId, double milliseconds)
+{
+    const int slot = currentThreadSlot();
+    CV_Assert(slot < MaxShards);
+
+    // Only contended while a report is being written
+    Shard& shard = m_shards[slot];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.latencies[Key(stage, algorithmId, transformationId)].add(milliseconds);
+}
+
+StageProfiler::LatencyMap StageProfiler::snapshot() const
+{
+    LatencyMap result;
+
+    for (int i = 0; i < MaxShards; i++)
+    {
+        Shard& shard = m_shards[i];
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        for (LatencyMap::const_iterator it = shard.latencies.begin(); it != shard.latencies.end(); ++it)
+            result[it->first].merge(it->second);
+    }
+
+    return result;
+}
+
+static const std::string& nameOrAny(const NameTable& names, int id)
+{
+    static const std::string any("*");
+    return id == StageProfiler::AnyName ? any : names.name(id);
+}
+
+//! Position of every id in the order of the names, with AnyName first.
+static std::vector<int> nameRanks(const NameTable& names)
+{
+    const std::vector<int>& sorted = names.sortedIds();
+    std::vector<int> ranks(sorted.size() + 1, 0);
+
+    for (size_t i = 0; i < sorted.size(); i++)
+        ranks[sorted[i] + 1] = i + 1;
+
+    return ranks;
+}
+
+std::ostream& StageProfiler::printLatencies(std::ostream& str) const
+{
+    const LatencyMap latencies = snapshot();
+
+    // The map is ordered by ids, the report by names as before
+    const std::vector<int> algorithmRanks      = nameRanks(NameTable::algorithms());
+    const std::vector<int> transformationRanks = nameRanks(NameTable::transformations());
+
+    std::vector<LatencyMap::const_iterator> rows;
+    for (LatencyMap::const_iterator it = latencies.begin(); it != latencies.end(); ++it)
+        rows.push_back(it);
+
+    std::sort(rows.begin(), rows.end(), [&](LatencyMap::const_iterator a, LatencyMap::const_iterator b)
+    {
+        return std::make_tuple(std::get<0>(a->first), algorithmRanks[std::get<1>(a->first) + 1], transformationRanks[std::get<2>(a->first) + 1]) <
+               std::make_tuple(std::get<0>(b->first), algorithmRanks[std::get<1>(b->first) + 1], transformationRanks[std::get<2>(b->first) + 1]);
+    });
+
+    str << "Stage\tAlgorithm\tTransformation\tCount\tTotalMs\tMeanMs\tStdDevMs\tP50Ms\tP95Ms\tP99Ms\tMaxMs" << std::endl;
+
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        const Key&          key = rows[r]->first;
+        const StageLatency& l   = rows[r]->second;
+
+        str << stageName(static_cast<EvaluationStage>(std::get<0>(key))) << "\t"
+            << nameOrAny(NameTable::algorithms(), std::get<1>(key)) << "\t"
+            << nameOrAny(NameTable::transformations(), std::get<2>(key)) << "\t"
+            << l.stats.count() << "\t"
+            << l.stats.mean() * l.stats.count() << "\t"
+            << l.stats.mean() << "\t"
+            << l.stats.stdDev() << "\t"
+            << l.histogram.quantile(0.50) << "\t"
+            << l.histogram.quantile(0.95) << "\t"
+            << l.histogram.quantile(0.99) << "\t"
+            << l.histogram.maximum() << std::endl;
+    }
+
+    return str;
+}
+
+#pragma mark - ScopedStageTimer implementation
+
+ScopedStageTimer::ScopedStageTimer(EvaluationStage stage, int algorithmId, int transformationId)
+: m_stage(stage)
+, m_algorithmId(algorithmId)
+, m_transformationId(transformationId)
+, m_start(cv::getTickCount())
+{
+}
+
+ScopedStageTimer::~ScopedStageTimer()
+{
+    const double ms = (cv::getTickCount() - m_start) * 1000. / cv::getTickFrequency();
+    StageProfiler::instance().record(m_stage, m_algorithmId, m_transformationId, ms);
+}
@@ -0,0 +1,91 @@
+#ifndef StageProfiler_hpp
+#define StageProfiler_hpp
+
+#include "RunningStatistics.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+//! Parts of the evaluation path that are timed separately.
+typedef enum
+{
+    StageDecode,
+    StageDetect,
+    StageWarp,
+    StageDescribe,
+    StageMatch,
+    StageGroundTruth
+} EvaluationStage;
+
+const char* stageName(EvaluationStage stage);
+
+//! Wall time distribution of one stage.
+struct StageLatency
+{
+    RunningStatistics stats;
+    LatencyHistogram  histogram;
+
+    void add(double milliseconds);
+    void merge(const StageLatency& other);
+};
+
+//! Process-wide latency histograms per stage, algorithm and transformation. Every thread records
+//! into its own shard, so recording does not contend; shards are merged only for a report.
+class StageProfiler
+{
+public:
+    //! (stage, algorithm id, transformation id), with the ids interned in NameTable. Ids are AnyName for
+    //! stages that do not depend on them.
+    typedef std::tuple<int, int, int>   Key;
+    typedef std::map<Key, StageLatency> LatencyMap;
+
+    static const int AnyName = -1;
+
+    static StageProfiler& instance();
+
+    void record(EvaluationStage stage, int algorithmId, int transformationId, double milliseconds);
+
+    //! Merged latencies of all threads recorded so far.
+    LatencyMap snapshot() const;
+
+    std::ostream& printLatencies(std::ostream& str) const;
+
+private:
+    StageProfiler();
+    StageProfiler(const StageProfiler&);
+    StageProfiler& operator=(const StageProfiler&);
+
+    static const int CacheLineSize = 64;
+    static const int MaxShards     = 256;
+
+    //! Every shard on its own cache lines, so that threads recording into neighbouring shards do not share a line
+    struct alignas(CacheLineSize) Shard
+    {
+        std::mutex lock;
+        LatencyMap latencies;
+    };
+
+    //! A plain array, as the profiler is a static object and vectors do not honour over-aligned types
+    mutable Shard m_shards[MaxShards];
+};
+
+//! Records the wall time of the enclosing scope.
+class ScopedStageTimer
+{
+public:
+    ScopedStageTimer(EvaluationStage stage,
+                     int algorithmId = StageProfiler::AnyName,
+                     int transformationId = StageProfiler::AnyName);
+    ~ScopedStageTimer();
+
+private:
+    EvaluationStage m_stage;
+    int             m_algorithmId;
+    int             m_transformationId;
+    int64           m_start;
+};
+
+#endif
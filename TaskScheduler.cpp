@@ -0,0 +1,200 @@
+#include "TaskScheduler.hpp"
+
+#include <algorithm>
+
+// Worker index of the calling thread in the scheduler that owns it
+static thread_local const TaskScheduler* currentScheduler = 0;
+static thread_local size_t               currentWorker    = 0;
+
+#pragma mark - TaskGraph implementation
+
+TaskGraph::Node::Node()
+: predecessors(0)
+, pending(0)
+{
+}
+
+TaskGraph::TaskGraph()
+: m_remaining(0)
+, m_failed(false)
+{
+}
+
+TaskGraph::Task TaskGraph::add(const std::function<void()>& work)
+{
+    m_nodes.emplace_back();
+    m_nodes.back().work = work;
+    return m_nodes.size() - 1;
+}
+
+void TaskGraph::precede(Task before, Task after)
+{
+    m_nodes[before].successors.push_back(after);
+    m_nodes[after].predecessors++;
+}
+
+size_t TaskGraph::size() const
+{
+    return m_nodes.size();
+}
+
+#pragma mark - TaskScheduler implementation
+
+TaskScheduler::TaskScheduler(int threads)
+: m_workers(std::max(threads, 1))
+, m_queued(0)
+, m_nextWorker(0)
+, m_stop(false)
+{
+    for (size_t i = 0; i < m_workers.size(); i++)
+        m_threads.push_back(std::thread(&TaskScheduler::workerLoop, this, i));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_sleepLock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+}
+
+void TaskScheduler::run(TaskGraph& graph)
+{
+    {
+        std::lock_guard<std::mutex> guard(graph.m_lock);
+        graph.m_remaining = graph.m_nodes.size();
+        graph.m_error     = std::exception_ptr();
+    }
+    graph.m_failed = false;
+
+    // All counters are set before the first task can finish and decrement them
+    for (size_t i = 0; i < graph.m_nodes.size(); i++)
+        graph.m_nodes[i].pending = graph.m_nodes[i].predecessors;
+
+    for (size_t i = 0; i < graph.m_nodes.size(); i++)
+    {
+        if (graph.m_nodes[i].predecessors == 0)
+            push(ReadyTask(&graph, i));
+    }
+}
+
+void TaskScheduler::wait(TaskGraph& graph)
+{
+    std::unique_lock<std::mutex> lock(graph.m_lock);
+    graph.m_done.wait(lock, [&graph] { return graph.m_remaining == 0; });
+
+    if (graph.m_error)
+    {
+        std::exception_ptr error = graph.m_error;
+        graph.m_error = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+}
+
+void TaskScheduler::push(const ReadyTask& task)
+{
+    // Tasks made ready by a worker stay with it, the others are dealt out in turn
+    const size_t worker = currentScheduler == this ? currentWorker : m_nextWorker++ % m_workers.size();
+
+    // Counted before it is published, so that a thief that takes it right away cannot decrement below zero
+    m_queued++;
+    {
+        std::lock_guard<std::mutex> guard(m_workers[worker].lock);
+        m_workers[worker].tasks.push_back(task);
+    }
+
+    // Taking the lock orders this push after the check of a worker that is about to sleep
+    {
+        std::lock_guard<std::mutex> guard(m_sleepLock);
+    }
+    m_wake.notify_one();
+}
+
+bool TaskScheduler::pop(size_t worker, ReadyTask& task)
+{
+    for (size_t k = 0; k < m_workers.size(); k++)
+    {
+        Worker& victim = m_workers[(worker + k) % m_workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if (victim.tasks.empty())
+            continue;
+
+        if (k == 0)
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+        }
+        else
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+        }
+
+        m_queued--;
+        return true;
+    }
+
+    return false;
+}
+
+void TaskScheduler::execute(const ReadyTask& task)
+{
+    TaskGraph& graph = *task.first;
+    TaskGraph::Node& node = graph.m_nodes[task.second];
+
+    // Successors still run so that the graph completes; their work is skipped after a failure
+    if (!graph.m_failed)
+    {
+        try
+        {
+            node.work();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(graph.m_lock);
+            if (!graph.m_error)
+                graph.m_error = std::current_exception();
+            graph.m_failed = true;
+        }
+    }
+
+    for (size_t i = 0; i < node.successors.size(); i++)
+    {
+        const TaskGraph::Task successor = node.successors[i];
+        if (--graph.m_nodes[successor].pending == 0)
+            push(ReadyTask(&graph, successor));
+    }
+
+    // Counted under the lock, so that a waiter cannot see the graph done and destroy it before the lock is released
+    std::lock_guard<std::mutex> guard(graph.m_lock);
+    if (--graph.m_remaining == 0)
+        graph.m_done.notify_all();
+}
+
+void TaskScheduler::workerLoop(size_t worker)
+{
+    currentScheduler = this;
+    currentWorker    = worker;
+
+    ReadyTask task;
+
+    while (true)
+    {
+        if (pop(worker, task))
+        {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+
+        if (m_stop)
+            return;
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef TaskScheduler_hpp
+#define TaskScheduler_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//! Tasks and the dependencies between them. A task is ready to run once all tasks it depends on are done.
+class TaskGraph
+{
+public:
+    typedef size_t Task;
+
+    TaskGraph();
+
+    Task add(const std::function<void()>& work);
+
+    //! The task after does not start before the task before is done.
+    void precede(Task before, Task after);
+
+    size_t size() const;
+
+private:
+    TaskGraph(const TaskGraph&);
+    TaskGraph& operator=(const TaskGraph&);
+
+    friend class TaskScheduler;
+
+    struct Node
+    {
+        Node();
+
+        std::function<void()> work;
+        std::vector<Task>     successors;
+        int                   predecessors;
+
+        //! Predecessors that are not done yet while the graph runs
+        std::atomic<int>      pending;
+    };
+
+    std::deque<Node>        m_nodes;
+
+    //! Tasks that are not done yet, guarded by m_lock
+    size_t                  m_remaining;
+    std::mutex              m_lock;
+    std::condition_variable m_done;
+
+    //! First exception thrown by a task, guarded by m_lock. Once a task has failed, the work of the
+    //! tasks that have not started yet is skipped.
+    std::exception_ptr      m_error;
+    std::atomic<bool>       m_failed;
+};
+
+//! Fixed pool of worker threads running the tasks of graphs, with work stealing. Every worker keeps the tasks
+//! that its own work makes ready in a deque and runs the newest first, so that dependent work follows while its
+//! inputs are still in cache. An idle worker takes the oldest task of another worker, which tends to lead to
+//! the most remaining work. Tasks of several graphs can be mixed, so one graph fills the cores the tail of another leaves idle.
+class TaskScheduler
+{
+public:
+    explicit TaskScheduler(int threads);
+    ~TaskScheduler();
+
+    //! Starts the tasks of the graph that depend on nothing; the others start when their last dependency is done.
+    //! Returns right away. The graph must not change and must stay alive until wait() returns.
+    void run(TaskGraph& graph);
+
+    //! Blocks until all tasks of the graph are done. Rethrows the first exception thrown by a task.
+    void wait(TaskGraph& graph);
+
+private:
+    TaskScheduler(const TaskScheduler&);
+    TaskScheduler& operator=(const TaskScheduler&);
+
+    typedef std::pair<TaskGraph*, TaskGraph::Task> ReadyTask;
+
+    struct Worker
+    {
+        std::mutex            lock;
+        std::deque<ReadyTask> tasks;
+    };
+
+    void push(const ReadyTask& task);
+    bool pop(size_t worker, ReadyTask& task);
+    void execute(const ReadyTask& task);
+    void workerLoop(size_t worker);
+
+    std::vector<Worker>      m_workers;
+    std::vector<std::thread> m_threads;
+
+    //! Ready tasks in all deques; idle workers sleep until there are some
+    std::atomic<size_t>      m_queued;
+    std::atomic<size_t>      m_nextWorker;
+
+    std::mutex               m_sleepLock;
+    std::condition_variable  m_wake;
+    bool                     m_stop;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "ThreadLocalPool.hpp"
+#include <atomic>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static std::atomic<int> nextThreadSlot(0);
+
+int currentThreadSlot()
+{
+    static thread_local int slot = nextThreadSlot++;
+    return slot;
+}
+
+int workerThreadCount()
+{
+#ifdef _OPENMP
+    int workers = omp_get_max_threads();
+#else
+    int workers = static_cast<int>(std::thread::hardware_concurrency());
+#endif
+
+    return std::max(workers, 1);
+}
+
+int expectedThreadCount()
+{
+    // Main thread and the image pipeline stages come on top of the worker threads
+    return workerThreadCount() + 4;
+}
@@ -0,0 +1,80 @@
+#ifndef ThreadLocalPool_hpp
+#define ThreadLocalPool_hpp
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+
+//! Small dense index of the calling thread, assigned on its first call.
+int currentThreadSlot();
+
+//! Number of threads that evaluate in parallel: the OpenMP team size, or the number of hardware threads.
+int workerThreadCount();
+
+//! Number of threads that are expected to run concurrently (workers plus main and pipeline threads).
+int expectedThreadCount();
+
+//! One instance of T per thread, created by a factory. A thread only ever touches its own slot,
+//! so instances (and their internal buffers) are never shared between threads.
+template<typename T>
+class ThreadLocalPool
+{
+public:
+    typedef std::function<cv::Ptr<T>()> Factory;
+
+    //! Upper bound on the number of distinct threads that can use a pool.
+    static const int MaxThreads = 256;
+
+    //! Creates instances for the first preconstructed thread slots right away; slots of
+    //! additional threads are filled lazily by the owning thread.
+    ThreadLocalPool(const Factory& factory, int preconstructed = expectedThreadCount())
+    : m_factory(factory)
+    , m_storage((MaxThreads + 1) * sizeof(Slot))
+    , m_slots(cv::alignPtr(reinterpret_cast<Slot*>(&m_storage[0]), CacheLineSize))
+    {
+        for (int i = 0; i < MaxThreads; i++)
+            new (&m_slots[i]) Slot();
+
+        for (int i = 0; i < preconstructed && i < MaxThreads; i++)
+            m_slots[i].instance = m_factory();
+    }
+
+    ~ThreadLocalPool()
+    {
+        for (int i = 0; i < MaxThreads; i++)
+            m_slots[i].~Slot();
+    }
+
+    //! Instance owned by the calling thread.
+    T& local() const
+    {
+        const int slot = currentThreadSlot();
+        CV_Assert(slot < MaxThreads);
+
+        Slot& s = m_slots[slot];
+        if (!s.instance)
+            s.instance = m_factory();
+
+        return *s.instance;
+    }
+
+private:
+    ThreadLocalPool(const ThreadLocalPool&);
+    ThreadLocalPool& operator=(const ThreadLocalPool&);
+
+    static const int CacheLineSize = 64;
+
+    // One cache line per slot, so that lazy creation by one thread does not invalidate its neighbours.
+    // std::vector does not honour the alignment of over-aligned types before C++17, so the slots are
+    // placed in storage that is aligned by hand.
+    struct alignas(CacheLineSize) Slot
+    {
+        cv::Ptr<T> instance;
+    };
+
+    Factory                    m_factory;
+    std::vector<unsigned char> m_storage;
+    Slot*                      m_slots;
+};
+
+#endif
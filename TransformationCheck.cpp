@@ -0,0 +1,235 @@
+#include "ImageTransformation.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+typedef std::pair<std::string, cv::Mat> NamedImage;
+
+static void printRow(const std::string& check, const std::string& image, double error, double tolerance)
+{
+    std::cout << std::setw(28) << check << std::setw(10) << image
+              << std::setw(12) << std::fixed << std::setprecision(3) << error
+              << std::setw(12) << tolerance
+              << std::setw(8) << (error <= tolerance ? "yes" : "NO") << std::endl;
+}
+
+//! Synthetic images that are hard on the sweeps: noise and a checkerboard have the most energy in high
+//! frequencies, the smooth gradient the least. The odd size catches off-by-one errors of the scaled sizes.
+static std::vector<NamedImage> testImages(cv::RNG& rng)
+{
+    std::vector<NamedImage> images;
+
+    cv::Mat noise(480, 640, CV_8U);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+    images.push_back(NamedImage("noise", noise));
+
+    cv::Mat checker(481, 643, CV_8U);
+    for (int y = 0; y < checker.rows; y++)
+        for (int x = 0; x < checker.cols; x++)
+            checker.at<uchar>(y, x) = ((x / 8 + y / 8) % 2) ? 230 : 25;
+    images.push_back(NamedImage("checker", checker));
+
+    cv::Mat smooth(480, 640, CV_8U);
+    for (int y = 0; y < smooth.rows; y++)
+        for (int x = 0; x < smooth.cols; x++)
+            smooth.at<uchar>(y, x) = cv::saturate_cast<uchar>(128 + 100 * std::sin(x * 0.02) * std::cos(y * 0.03));
+    images.push_back(NamedImage("smooth", smooth));
+
+    return images;
+}
+
+//! Largest difference in grey levels between the frames of transformSweep and transforming the source for every
+//! argument separately, or infinity if the frames do not have the same sizes.
+static double sweepError(const ImageTransformation& transformation, const cv::Mat& source)
+{
+    const std::vector<float> args = transformation.getX();
+
+    std::vector<cv::Mat> sweep;
+    transformation.transformSweep(source, sweep);
+
+    if (sweep.size() != args.size())
+        return std::numeric_limits<double>::infinity();
+
+    double error = 0;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        cv::Mat direct;
+        transformation.transform(args[i], source, direct);
+
+        if (direct.size() != sweep[i].size() || direct.type() != sweep[i].type())
+            return std::numeric_limits<double>::infinity();
+
+        error = std::max(error, cv::norm(direct, sweep[i], cv::NORM_INF));
+    }
+
+    return error;
+}
+
+//! Grid of keypoints over a source image of the given size, with varied scales and angles. Some have no angle.
+static Keypoints testKeypoints(const cv::Size& size)
+{
+    Keypoints keypoints;
+
+    for (int y = 0; y <= size.height; y += size.height / 12)
+    {
+        for (int x = 0; x <= size.width; x += size.width / 16)
+        {
+            const int   i     = static_cast<int>(keypoints.size());
+            const float angle = (i % 7 == 0) ? -1.f : (i * 37) % 360;
+            keypoints.push_back(cv::KeyPoint(cv::Point2f(x + 0.25f, y + 0.75f), 7.f + (i % 5) * 6, angle));
+        }
+    }
+
+    return keypoints;
+}
+
+//! Largest distance between the keypoints and the expected positions, or infinity if their counts differ.
+static double positionError(const Keypoints& keypoints, const std::vector<cv::Point2f>& expected)
+{
+    if (keypoints.size() != expected.size())
+        return std::numeric_limits<double>::infinity();
+
+    double error = 0;
+    for (size_t i = 0; i < keypoints.size(); i++)
+        error = std::max(error, cv::norm(keypoints[i].pt - expected[i]));
+
+    return error;
+}
+
+//! Largest relative difference of the sizes and largest difference of the angles in degrees, or infinity if
+//! the counts differ or only one of two keypoints has an angle.
+static void shapeErrors(const Keypoints& a, const Keypoints& b, double& sizeError, double& angleError)
+{
+    sizeError  = 0;
+    angleError = 0;
+
+    if (a.size() != b.size())
+    {
+        sizeError = angleError = std::numeric_limits<double>::infinity();
+        return;
+    }
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        sizeError = std::max(sizeError, std::abs(a[i].size - b[i].size) / static_cast<double>(b[i].size));
+
+        if ((a[i].angle < 0) != (b[i].angle < 0))
+        {
+            angleError = std::numeric_limits<double>::infinity();
+        }
+        else if (a[i].angle >= 0)
+        {
+            const double d = std::fmod(std::abs(a[i].angle - b[i].angle), 360.);
+            angleError = std::max(angleError, std::min(d, 360. - d));
+        }
+    }
+}
+
+//! Compares the keypoints of every argument of the transformation with the source keypoints mapped through its
+//! homography: the positions of its keypoint transform and of projectKeypoints with cv::perspectiveTransform,
+//! and the scales and angles of its keypoint transform with those of projectKeypoints.
+static bool checkKeypoints(const ImageTransformation& transformation, const cv::Size& sourceSize, const Keypoints& source)
+{
+    const double positionTolerance = 0.01;
+    const double sizeTolerance     = 1e-4;
+    const double angleTolerance    = 0.01;
+
+    std::vector<cv::Point2f> points;
+    cv::KeyPoint::convert(source, points);
+
+    double transformError = 0, projectError = 0, sizeError = 0, angleError = 0;
+
+    const std::vector<float> args = transformation.getX();
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const cv::Matx33d homography = transformation.homography(args[i], sourceSize);
+
+        std::vector<cv::Point2f> expected;
+        cv::perspectiveTransform(points, expected, homography);
+
+        Keypoints transformed, projected;
+        transformation.transform(args[i], sourceSize, source, transformed);
+        ImageTransformation::projectKeypoints(homography, source, projected);
+
+        double s, a;
+        shapeErrors(transformed, projected, s, a);
+
+        transformError = std::max(transformError, positionError(transformed, expected));
+        projectError   = std::max(projectError, positionError(projected, expected));
+        sizeError      = std::max(sizeError, s);
+        angleError     = std::max(angleError, a);
+    }
+
+    std::ostringstream image;
+    image << sourceSize.width << "x" << sourceSize.height;
+
+    printRow(transformation.name + " keypoints", image.str(), transformError, positionTolerance);
+    printRow(transformation.name + " projected", image.str(), projectError, positionTolerance);
+    printRow(transformation.name + " scale", image.str(), sizeError, sizeTolerance);
+    printRow(transformation.name + " angle", image.str(), angleError, angleTolerance);
+
+    return transformError <= positionTolerance && projectError <= positionTolerance &&
+           sizeError <= sizeTolerance && angleError <= angleTolerance;
+}
+
+//! Checks that the transformations that produce their frames incrementally stay close to transforming the
+//! source directly, and that keypoints follow the homographies of the transformations. Exits with a non-zero
+//! status if any check fails.
+int main(int argc, const char* argv[])
+{
+    cv::RNG rng(0x5eed);
+    const std::vector<NamedImage> images = testImages(rng);
+    bool passed = true;
+
+    std::cout << std::setw(28) << "Check" << std::setw(10) << "Image"
+              << std::setw(12) << "Error" << std::setw(12) << "Tolerance" << std::setw(8) << "Pass" << std::endl;
+
+    // Composing Gaussian kernels is exact only for continuous kernels; brightness goes through a lookup table
+    // that gives the same pixels as the direct transform
+    std::vector<std::pair<cv::Ptr<ImageTransformation>, double> > sweeps;
+    sweeps.push_back(std::make_pair(cv::Ptr<ImageTransformation>(new GaussianBlurTransform(15)), 3.0));
+    sweeps.push_back(std::make_pair(cv::Ptr<ImageTransformation>(new BrightnessImageTransform(-175, +175, 25)), 0.0));
+
+    for (size_t t = 0; t < sweeps.size(); t++)
+    {
+        const ImageTransformation& transformation = *sweeps[t].first;
+
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            double error = sweepError(transformation, images[i].second);
+            printRow(transformation.name + " sweep", images[i].first, error, sweeps[t].second);
+            passed = passed && error <= sweeps[t].second;
+        }
+    }
+
+    // The transformations of the evaluation; the combined ones cover both the multiplied homographies and
+    // keypoints mapped by each step in turn
+    std::vector<cv::Ptr<ImageTransformation> > transformations;
+    transformations.push_back(cv::Ptr<ImageTransformation>(new GaussianBlurTransform(15)));
+    transformations.push_back(cv::Ptr<ImageTransformation>(new ImageRotationTransformation(0, 90, 5, cv::Point2f(0.5f, 0.5f))));
+    transformations.push_back(cv::Ptr<ImageTransformation>(new ImageScalingTransformation(0.5f, 2.0f, 0.25f)));
+    transformations.push_back(cv::Ptr<ImageTransformation>(new CombinedTransform(
+        cv::Ptr<ImageTransformation>(new ImageScalingTransformation(0.75f, 1.75f, 0.25f)),
+        cv::Ptr<ImageTransformation>(new ImageRotationTransformation(0, 45, 15, cv::Point2f(0.5f, 0.5f))),
+        CombinedTransform::ParamCombinationType::Full)));
+    transformations.push_back(cv::Ptr<ImageTransformation>(new BrightnessImageTransform(-175, +175, 25)));
+    transformations.push_back(cv::Ptr<ImageTransformation>(new CombinedTransform(
+        cv::Ptr<ImageTransformation>(new ImageXRotationTransformation(0, 40, 10, cv::Point2f(0.5f, 0.5f))),
+        cv::Ptr<ImageTransformation>(new ImageYRotationTransformation(0, 40, 10, cv::Point2f(0.5f, 0.5f))),
+        CombinedTransform::ParamCombinationType::Full)));
+    transformations.push_back(cv::Ptr<ImageTransformation>(new PerspectiveTransform(10)));
+
+    const cv::Size  sourceSize(643, 481);
+    const Keypoints source = testKeypoints(sourceSize);
+
+    for (size_t t = 0; t < transformations.size(); t++)
+        passed = checkKeypoints(*transformations[t], sourceSize, source) && passed;
+
+    return passed ? 0 : 1;
+}
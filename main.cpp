@@ -2,10 +2,18 @@
 #include "CollectedStatistics.hpp"
 #include "FeatureAlgorithm.hpp"
 #include "AlgorithmEstimation.hpp"
+#include "ImagePipeline.hpp"
+#include "PackedDataset.hpp"
+#include "ResultsJournal.hpp"
+#include "StageProfiler.hpp"
+#include "RemapCache.hpp"
+#include "TaskScheduler.hpp"
+#include "ThreadLocalPool.hpp"
 
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
 #include "opencv2/core.hpp"
 #include "opencv2/core/utility.hpp"
 #include "opencv2/core/ocl.hpp"
@@ -19,26 +27,254 @@
 #include <numeric>
 #include <fstream>
 #include <cassert>
+#include <csignal>
+#include <deque>
+#include <set>
 
 const bool USE_VERBOSE_TRANSFORMATIONS = false;
 namespace fs = boost::filesystem;
+namespace po = boost::program_options;
 
-int main(int argc, const char* argv[])
+//! Materializes the human-readable tables of all results collected so far.
+static void writeReports(const CollectedStatistics& fullStat)
 {
-    std::vector<FeatureAlgorithm>              algorithms;
-    std::vector<cv::Ptr<ImageTransformation> > transformations;
+    std::ofstream recallLog("Recall_.txt");
+    fullStat.printStatistics(recallLog, StatisticsElementRecall);
 
-    bool useBF = true;
+    std::ofstream precisionLog("Precision_.txt");
+    fullStat.printStatistics(precisionLog, StatisticsElementPrecision);
 
-    // Initialize list of algorithm tuples:
+    std::ofstream repeatabilityLog("Repeatability_.txt");
+    fullStat.printStatistics(repeatabilityLog, StatisticsElementRepeatability);
+
+    std::ofstream matchingScoreLog("MatchingScore_.txt");
+    fullStat.printStatistics(matchingScoreLog, StatisticsElementMatchingScore);
+
+    std::ofstream memoryAllocatedLog("MemoryAllocated_.txt");
+    fullStat.printStatistics(memoryAllocatedLog, StatisticsElementMemoryAllocated);
+
+    std::ofstream ConsumedTimeMsLog("ConsumedTimeMs.txt");
+    fullStat.printStatistics(ConsumedTimeMsLog, StatisticsElementConsumedTimeMs);
+
+    std::ofstream memoryAllocatedPerDescriptorLog("MemoryAllocatedPerDescriptor_.txt");
+    fullStat.printStatistics(memoryAllocatedPerDescriptorLog, StatisticsElementMemoryAllocatedPerDescriptor);
+
+    std::ofstream ConsumedTimeMsPerDescriptorLog("ConsumedTimeMsPerDescriptor_.txt");
+    fullStat.printStatistics(ConsumedTimeMsPerDescriptorLog, StatisticsElementConsumedTimeMsPerDescriptor);
+
+    std::ofstream TotalKeypointsLog("TotalKeypoints_.txt");
+    fullStat.printStatistics(TotalKeypointsLog, StatisticsElementPointsCount);
+
+    std::ofstream allocationsPerDescriptorLog("AllocationsPerDescriptor_.txt");
+    fullStat.printStatistics(allocationsPerDescriptorLog, StatisticsElementAllocationsPerDescriptor);
+
+    std::ofstream peakMemoryLog("PeakMemory_.txt");
+    fullStat.printStatistics(peakMemoryLog, StatisticsElementPeakMemory);
+
+    std::ofstream matchMemoryAllocatedPerDescriptorLog("MatchMemoryAllocatedPerDescriptor_.txt");
+    fullStat.printStatistics(matchMemoryAllocatedPerDescriptorLog, StatisticsElementMatchMemoryAllocatedPerDescriptor);
+
+    std::ofstream matchAllocationsPerDescriptorLog("MatchAllocationsPerDescriptor_.txt");
+    fullStat.printStatistics(matchAllocationsPerDescriptorLog, StatisticsElementMatchAllocationsPerDescriptor);
+
+    std::ofstream matchPeakMemoryLog("MatchPeakMemory_.txt");
+    fullStat.printStatistics(matchPeakMemoryLog, StatisticsElementMatchPeakMemory);
+
+    std::ofstream precisionStdDevLog("PrecisionStdDev_.txt");
+    fullStat.printStatistics(precisionStdDevLog, StatisticsElementPrecisionStdDev);
+
+    std::ofstream recallStdDevLog("RecallStdDev_.txt");
+    fullStat.printStatistics(recallStdDevLog, StatisticsElementRecallStdDev);
 
-    algorithms.push_back(FeatureAlgorithm("ORB",   cv::ORB::create(),   useBF));
-    algorithms.push_back(FeatureAlgorithm("BRISK", cv::BRISK::create(), useBF));
-    algorithms.push_back(FeatureAlgorithm("SURF",  cv::xfeatures2d::SURF::create(),  useBF));
-    algorithms.push_back(FeatureAlgorithm("FREAK",  cv::xfeatures2d::FREAK::create(),  useBF));
-    algorithms.push_back(FeatureAlgorithm("SIFT",  cv::xfeatures2d::SIFT::create(),  useBF));
-    algorithms.push_back(FeatureAlgorithm("BRIEF",  cv::xfeatures2d::BriefDescriptorExtractor::create(),  useBF));
-    algorithms.push_back(FeatureAlgorithm("LATCH",  cv::xfeatures2d::LATCH::create(),  useBF));
+    std::ofstream consumedTimeMsMeanLog("ConsumedTimeMsMean_.txt");
+    fullStat.printStatistics(consumedTimeMsMeanLog, StatisticsElementConsumedTimeMsMean);
+
+    std::ofstream consumedTimeMsStdDevLog("ConsumedTimeMsStdDev_.txt");
+    fullStat.printStatistics(consumedTimeMsStdDevLog, StatisticsElementConsumedTimeMsStdDev);
+
+    std::ofstream consumedTimeMsP50Log("ConsumedTimeMsP50_.txt");
+    fullStat.printStatistics(consumedTimeMsP50Log, StatisticsElementConsumedTimeMsP50);
+
+    std::ofstream consumedTimeMsP95Log("ConsumedTimeMsP95_.txt");
+    fullStat.printStatistics(consumedTimeMsP95Log, StatisticsElementConsumedTimeMsP95);
+
+    std::ofstream consumedTimeMsP99Log("ConsumedTimeMsP99_.txt");
+    fullStat.printStatistics(consumedTimeMsP99Log, StatisticsElementConsumedTimeMsP99);
+
+    const std::pair<const char*, StatisticElement> counterReports[] =
+    {
+        std::make_pair("DescribeCyclesPerDescriptor_.txt",       StatisticsElementDescribeCyclesPerDescriptor),
+        std::make_pair("DescribeInstructionsPerDescriptor_.txt", StatisticsElementDescribeInstructionsPerDescriptor),
+        std::make_pair("DescribeCacheMissesPerDescriptor_.txt",  StatisticsElementDescribeCacheMissesPerDescriptor),
+        std::make_pair("DescribeBranchMissesPerDescriptor_.txt", StatisticsElementDescribeBranchMissesPerDescriptor),
+        std::make_pair("MatchCyclesPerDescriptor_.txt",          StatisticsElementMatchCyclesPerDescriptor),
+        std::make_pair("MatchInstructionsPerDescriptor_.txt",    StatisticsElementMatchInstructionsPerDescriptor),
+        std::make_pair("MatchCacheMissesPerDescriptor_.txt",     StatisticsElementMatchCacheMissesPerDescriptor),
+        std::make_pair("MatchBranchMissesPerDescriptor_.txt",    StatisticsElementMatchBranchMissesPerDescriptor)
+    };
+
+    // Only meaningful when the counters were enabled for the run
+    if (PerfCounters::isEnabled())
+    {
+        for (size_t i = 0; i < sizeof(counterReports) / sizeof(counterReports[0]); i++)
+        {
+            std::ofstream counterLog(counterReports[i].first);
+            fullStat.printStatistics(counterLog, counterReports[i].second);
+        }
+    }
+
+    std::ofstream stageLatencyLog("StageLatency_.txt");
+    StageProfiler::instance().printLatencies(stageLatencyLog);
+
+    std::ofstream remapCacheLog("RemapCache_.txt");
+    RemapCache::instance().printStatistics(remapCacheLog);
+}
+
+static bool parseMatcherBackend(const std::string& name, MatcherBackend& backend)
+{
+    if (name == "opencv")
+        backend = MatcherBackendOpenCV;
+    else if (name == "simd")
+        backend = MatcherBackendSimd;
+    else if (name == "mih")
+        backend = MatcherBackendMih;
+    else
+        return false;
+
+    return true;
+}
+
+//! Everything one source image needs while its tasks are in flight.
+struct ImageEvaluation
+{
+    ImageEvaluation(const FeatureCache& featureCache, bool projectedKeypoints)
+    : frames(featureCache, projectedKeypoints)
+    {
+    }
+
+    SourceFrame                     source;
+    FrameCache                      frames;
+
+    //! Source keypoints, their indices in source.keypoints and the matcher index of every algorithm
+    std::vector<Keypoints>          sourceKp;
+    std::vector<std::vector<int> >  sourceKpIndices;
+    std::vector<PreparedTrainSet>   sourceTrain;
+
+    //! Frames evaluated so far, merged into stat once the graph is done
+    ShardedStatistics               shards;
+    CollectedStatistics             stat;
+    TaskGraph                       graph;
+};
+
+//! Builds the tasks of one image: a warp per frame (or per incremental sweep) followed by the completion
+//! of each frame, the source descriptors and matcher index of each algorithm, and one evaluation per
+//! (algorithm, transformation, argument) that waits for its frame and its algorithm only.
+static void buildImageGraph(ImageEvaluation& image,
+                            const std::vector<FeatureAlgorithm>& algorithms,
+                            const std::vector<cv::Ptr<ImageTransformation> >& transformations,
+                            const FeatureCache& featureCache)
+{
+    FrameCache& frames = image.frames;
+    TaskGraph&  graph  = image.graph;
+
+    frames.prepare(image.source.image, image.source.hash, image.source.keypoints, transformations);
+
+    std::vector<std::vector<TaskGraph::Task> > frameTasks(transformations.size());
+    for (size_t transformIndex = 0; transformIndex < transformations.size(); transformIndex++)
+        frameTasks[transformIndex].resize(frames.frames(transformIndex).size());
+
+    for (size_t job = 0; job < frames.warpJobs().size(); job++)
+    {
+        const FrameCache::WarpJob& warpJob = frames.warpJobs()[job];
+        const TaskGraph::Task warp = graph.add([&frames, job] { frames.warp(job); });
+
+        const size_t first = warpJob.frameIndex >= 0 ? warpJob.frameIndex : 0;
+        const size_t last  = warpJob.frameIndex >= 0 ? warpJob.frameIndex + 1 : frames.frames(warpJob.transformIndex).size();
+
+        for (size_t i = first; i < last; i++)
+        {
+            const size_t transformIndex = warpJob.transformIndex;
+            frameTasks[transformIndex][i] = graph.add([&frames, transformIndex, i] { frames.completeFrame(transformIndex, i); });
+            graph.precede(warp, frameTasks[transformIndex][i]);
+        }
+    }
+
+    image.sourceKp.resize(algorithms.size());
+    image.sourceKpIndices.resize(algorithms.size());
+    image.sourceTrain.resize(algorithms.size());
+
+    for (size_t algIndex = 0; algIndex < algorithms.size(); algIndex++)
+    {
+        const FeatureAlgorithm& alg = algorithms[algIndex];
+        const int algorithmId = NameTable::algorithms().intern(alg.name);
+
+        const TaskGraph::Task describe = graph.add([&image, &alg, &featureCache, algorithmId, algIndex]
+        {
+            const SourceFrame& source = image.source;
+            Keypoints   kp;
+            Descriptors desc;
+
+            CachedFeatures cached;
+            if (featureCache.load(source.cacheKey, alg.fingerprint, cached))
+            {
+                kp   = cached.keypoints;
+                desc = cached.descriptors;
+            }
+            else
+            {
+                ScopedStageTimer timer(StageDescribe, algorithmId);
+
+                kp   = source.keypoints;
+                desc = alg.getDescriptors(source.image, kp);
+
+                cached.keypoints   = kp;
+                cached.descriptors = desc;
+                featureCache.store(source.cacheKey, alg.fingerprint, cached);
+            }
+
+            // Matcher index of the source descriptors, shared by all frames of all transformations
+            {
+                ScopedStageTimer timer(StageMatch, algorithmId);
+                alg.prepareTrainSet(desc, image.sourceTrain[algIndex]);
+            }
+
+            image.sourceKpIndices[algIndex] = FrameCache::subsetIndices(source.keypoints, kp);
+            image.sourceKp[algIndex].swap(kp);
+        });
+
+        for (size_t transformIndex = 0; transformIndex < transformations.size(); transformIndex++)
+        {
+            const ImageTransformation& trans = *transformations[transformIndex].get();
+            const int transformationId = NameTable::transformations().intern(trans.name);
+
+            for (size_t i = 0; i < frameTasks[transformIndex].size(); i++)
+            {
+                const TaskGraph::Task evaluate = graph.add([&image, &alg, &trans, &featureCache, algorithmId, transformationId, algIndex, transformIndex, i]
+                {
+                    FrameMatchingStatistics s;
+                    evaluateFrame(alg, trans, algorithmId, transformationId, image.frames.frames(transformIndex)[i], featureCache,
+                                  image.sourceKp[algIndex], image.sourceKpIndices[algIndex], image.sourceTrain[algIndex], s);
+                    image.shards.record(algorithmId, transformationId, i, s);
+                });
+
+                graph.precede(describe, evaluate);
+                graph.precede(frameTasks[transformIndex][i], evaluate);
+            }
+        }
+    }
+}
+
+static volatile std::sig_atomic_t reportRequested = 0;
+
+static void requestReport(int)
+{
+    reportRequested = 1;
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<FeatureAlgorithm>              algorithms;
+    std::vector<cv::Ptr<ImageTransformation> > transformations;
 
     transformations.push_back(cv::Ptr<ImageTransformation>(new GaussianBlurTransform(15)));
 
@@ -56,87 +292,187 @@ int main(int argc, const char* argv[])
     cv::Ptr<ImageTransformation> y = cv::Ptr<ImageTransformation>(new ImageYRotationTransformation(0, 40, 10, cv::Point2f(0.5f, 0.5f)));
     transformations.push_back(cv::Ptr<ImageTransformation>(new CombinedTransform(x, y, CombinedTransform::ParamCombinationType::Full)));
 
-    if (argc != 2)
+    size_t queueDepth = 4;
+    bool projectedKeypoints = false;
+    std::string cacheFolder;
+    std::string journalPath = "Journal_.bin";
+    bool resume = false;
+    bool perfCounters = false;
+    std::string matcherName = "opencv";
+    float maxRatio = 0;
+    size_t remapCacheMb = 256;
+    std::string sourceFolder;
+
+    po::options_description options("Options");
+    options.add_options()
+        ("help", "Print this message")
+        ("queue-depth", po::value<size_t>(&queueDepth)->default_value(queueDepth), "Number of images decoded and detected ahead of the evaluation")
+        ("projected-keypoints", po::bool_switch(&projectedKeypoints), "Describe source keypoints projected into the transformed frames instead of detecting keypoints on them")
+        ("cache-dir", po::value<std::string>(&cacheFolder), "Folder of the persistent keypoint and descriptor cache (disabled if not set)")
+        ("journal", po::value<std::string>(&journalPath)->default_value(journalPath), "Append-only journal of the per-image results")
+        ("resume", po::bool_switch(&resume), "Restore the results of a previous run from the journal and skip its completed images")
+        ("perf-counters", po::bool_switch(&perfCounters), "Count cycles, instructions, cache and branch misses of descriptor extraction and matching (Linux only)")
+        ("matcher", po::value<std::string>(&matcherName)->default_value(matcherName), "Matcher implementation: opencv, simd (in-tree vectorized brute force) or mih (exact multi-index hashing)")
+        ("ratio-test", po::value<float>(&maxRatio)->default_value(maxRatio), "Also evaluate every algorithm with two nearest neighbour matching and this ratio test (disabled if 0)")
+        ("remap-cache-mb", po::value<size_t>(&remapCacheMb)->default_value(remapCacheMb), "Memory for the coordinate maps of warps reused across images of the same size (disabled if 0)");
+
+    po::options_description hidden;
+    hidden.add_options()
+        ("source", po::value<std::string>(&sourceFolder), "Source folder of the images to be evaluated, or a packed dataset written by DatasetPacker");
+
+    po::options_description all;
+    all.add(options).add(hidden);
+
+    po::positional_options_description positional;
+    positional.add("source", 1);
+
+    po::variables_map vm;
+    try
     {
-        std::cout << "One input folder should be passed" << std::endl;
+        po::store(po::command_line_parser(argc, argv).options(all).positional(positional).run(), vm);
+        po::notify(vm);
+    }
+    catch (const po::error& e)
+    {
+        std::cout << e.what() << std::endl;
+        return 1;
     }
-    Keypoints sourceKp;
-    Descriptors sourceDesc;
-    cv::Mat sourceImage;
-    cv::Ptr<cv::Feature2D> surf_detector = cv::xfeatures2d::SURF::create();
-    std::string testImagePath;
-    fs::path srcDir(argv[1]);
-    fs::directory_iterator it(srcDir), eod;
-    CollectedStatistics fullStat;
-    BOOST_FOREACH(fs::path const & testImagePath, std::make_pair(it, eod)) {
-        std::string testImageName = testImagePath.filename().string();
-        if (fs::is_regular_file(testImagePath) && testImageName[0] != '.') {
-            std::cout << "Testing " << testImageName << std::endl;
 
-            cv::Mat fullTestImage = cv::imread(testImagePath.string());
+    if (vm.count("help") || sourceFolder.empty())
+    {
+        if (sourceFolder.empty())
+            std::cout << "One input folder should be passed" << std::endl;
 
-            cv::Mat testImage;
+        std::cout << "Usage: " << argv[0] << " [options] Source" << std::endl << options << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
 
-            if (fullTestImage.channels() == 3)
-            {
-                cv::cvtColor(fullTestImage, testImage, cv::COLOR_BGR2GRAY);
-            }
-            else if (fullTestImage.channels() == 4)
-            {
-                cv::cvtColor(fullTestImage, testImage, cv::COLOR_BGRA2GRAY);
-            }
-            else if (fullTestImage.channels() == 1)
-            {
-                testImage = fullTestImage;
-            }
+    if (fs::is_regular_file(sourceFolder) && !PackedDataset().open(sourceFolder))
+    {
+        std::cout << sourceFolder << " is neither a folder nor a packed dataset" << std::endl;
+        return 1;
+    }
 
-            surf_detector->detect(testImage, sourceKp);
+    MatcherBackend matcherBackend;
+    if (!parseMatcherBackend(matcherName, matcherBackend))
+    {
+        std::cout << "Unknown matcher " << matcherName << std::endl;
+        return 1;
+    }
 
-            if (testImage.empty())
-            {
-                std::cout << "Cannot read image from " << testImagePath << std::endl;
-            }
+    PerfCounters::setEnabled(perfCounters);
 
-            for (size_t algIndex = 0; algIndex < algorithms.size(); algIndex++)
-            {
-                const FeatureAlgorithm& alg   = algorithms[algIndex];
-                Keypoints tempKp = sourceKp;
-                sourceDesc = alg.getDescriptors(testImage, tempKp);
-                std::cout << "Testing " << alg.name << "...";
+    // The task scheduler already keeps every core busy. OpenCV's own parallel_for_ threads would only
+    // oversubscribe them, and the per-thread performance counters and allocation counts would miss their work.
+    cv::setNumThreads(1);
+    RemapCache::instance().setCapacity(remapCacheMb << 20);
 
-                for (size_t transformIndex = 0; transformIndex < transformations.size(); transformIndex++)
-                {
-                    const ImageTransformation& trans = *transformations[transformIndex].get();
-                    performEstimation(alg, trans, testImage.clone(), tempKp, sourceDesc, fullStat.getStatistics(alg.name, trans.name));
-                }
-                sourceDesc.release();
-                std::cout << "done." << std::endl;
-            }
+    bool useBF = true;
+
+    // Initialize list of algorithm tuples:
+
+    algorithms.push_back(FeatureAlgorithm("ORB",   [] { return cv::ORB::create(); },   useBF, matcherBackend));
+    algorithms.push_back(FeatureAlgorithm("BRISK", [] { return cv::BRISK::create(); }, useBF, matcherBackend));
+    algorithms.push_back(FeatureAlgorithm("SURF",  [] { return cv::xfeatures2d::SURF::create(); },  useBF, matcherBackend));
+    algorithms.push_back(FeatureAlgorithm("FREAK",  [] { return cv::xfeatures2d::FREAK::create(); },  useBF, matcherBackend));
+    algorithms.push_back(FeatureAlgorithm("SIFT",  [] { return cv::xfeatures2d::SIFT::create(); },  useBF, matcherBackend));
+    algorithms.push_back(FeatureAlgorithm("BRIEF",  [] { return cv::xfeatures2d::BriefDescriptorExtractor::create(); },  useBF, matcherBackend));
+    algorithms.push_back(FeatureAlgorithm("LATCH",  [] { return cv::xfeatures2d::LATCH::create(); },  useBF, matcherBackend));
+
+    if (maxRatio > 0)
+    {
+        const size_t crossCheckedCount = algorithms.size();
+        for (size_t algIndex = 0; algIndex < crossCheckedCount; algIndex++)
+            algorithms.push_back(algorithms[algIndex].withRatioTest(maxRatio));
+    }
+
+    CollectedStatistics fullStat;
+    ResultsJournal journal(journalPath);
+    std::set<std::string> completedImages;
+
+#ifdef SIGUSR1
+    // Tables are only written at exit, or when requested with kill -USR1
+    std::signal(SIGUSR1, requestReport);
+#endif
 
-            sourceKp.clear();
+    if (resume)
+    {
+        journal.restore(fullStat, completedImages);
+        std::cout << "Resuming after " << completedImages.size() << " completed images" << std::endl;
+    }
+    else
+    {
+        journal.rotate();
+    }
+
+    FeatureCache featureCache(cacheFolder);
+    ImagePipeline pipeline(fs::path(sourceFolder), queueDepth, featureCache, completedImages);
+    TaskScheduler scheduler(workerThreadCount());
+    SourceFrame source;
 
+    // The tasks of the next image start while the last tasks of the previous one are still running,
+    // so that the cores do not idle at image boundaries. Images are finished in order.
+    const size_t imagesInFlight = 2;
+    std::deque<cv::Ptr<ImageEvaluation> > inFlight;
+
+    auto finishOldest = [&]()
+    {
+        ImageEvaluation& image = *inFlight.front();
+
+        // A failed image is left out of the statistics and the journal, so that --resume evaluates it again
+        try
+        {
+            scheduler.wait(image.graph);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << "Evaluation of " << image.source.name << " failed: " << e.what() << std::endl;
+            inFlight.pop_front();
+            return;
         }
-        std::ofstream recallLog("Recall_.txt");
-        fullStat.printStatistics(recallLog, StatisticsElementRecall);
 
-        std::ofstream precisionLog("Precision_.txt");
-        fullStat.printStatistics(precisionLog, StatisticsElementPrecision);
+        image.shards.collect(image.stat);
 
-        std::ofstream memoryAllocatedLog("MemoryAllocated_.txt");
-        fullStat.printStatistics(memoryAllocatedLog, StatisticsElementMemoryAllocated);
+        journal.append(image.source.name, image.stat);
+        fullStat.merge(image.stat);
+        std::cout << "Finished " << image.source.name << std::endl;
+        inFlight.pop_front();
 
-        std::ofstream ConsumedTimeMsLog("ConsumedTimeMs.txt");
-        fullStat.printStatistics(ConsumedTimeMsLog, StatisticsElementConsumedTimeMs);
+        if (reportRequested)
+        {
+            reportRequested = 0;
+            writeReports(fullStat);
+        }
+    };
+
+    while (pipeline.next(source))
+    {
+        std::cout << "Testing " << source.name << std::endl;
+
+        if (source.image.empty())
+        {
+            std::cout << "Cannot read image from " << source.path << std::endl;
+            continue;
+        }
 
-        std::ofstream memoryAllocatedPerDescriptorLog("MemoryAllocatedPerDescriptor_.txt");
-        fullStat.printStatistics(memoryAllocatedPerDescriptorLog, StatisticsElementMemoryAllocatedPerDescriptor);
+        cv::Ptr<ImageEvaluation> image(new ImageEvaluation(featureCache, projectedKeypoints));
+        image->source = source;
 
-        std::ofstream ConsumedTimeMsPerDescriptorLog("ConsumedTimeMsPerDescriptor_.txt");
-        fullStat.printStatistics(ConsumedTimeMsPerDescriptorLog, StatisticsElementConsumedTimeMsPerDescriptor);
+        // Warping and detection on the transformed frames are shared by all algorithms
+        buildImageGraph(*image, algorithms, transformations, featureCache);
+        scheduler.run(image->graph);
+        inFlight.push_back(image);
 
-        std::ofstream TotalKeypointsLog("TotalKeypoints_.txt");
-        fullStat.printStatistics(TotalKeypointsLog, StatisticsElementPointsCount);
+        if (inFlight.size() >= imagesInFlight)
+            finishOldest();
     }
+
+    while (!inFlight.empty())
+        finishOldest();
+
+    journal.close();
+    writeReports(fullStat);
+
     fullStat.printAverage(std::cout, StatisticsElementRecall);
     fullStat.printAverage(std::cout, StatisticsElementPrecision);
 